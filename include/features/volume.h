@@ -0,0 +1,24 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+/* Audio backend, all calls run on the volume worker thread */
+typedef struct {
+    const char *name;
+    /* Change the volume by delta percent, returns 0 on success */
+    int (*adjust)(int delta);
+    /* Flip the mute state, returns 0 on success */
+    int (*toggle_mute)();
+    /* Read the current state, returns 0 on success */
+    int (*query)(int *percent, int *muted);
+} VolumeBackend;
+
+extern const VolumeBackend volume_backend_pactl;
+extern const VolumeBackend volume_backend_stub;
+
+const VolumeBackend *mocha_volume_backend_by_name(const char *name);
+int mocha_volume_init(const VolumeBackend *backend);
+void mocha_volume_adjust(int delta);
+void mocha_volume_toggle_mute();
+void mocha_volume_handle_result(int fd, void *data);
+
+#endif  // VOLUME_H
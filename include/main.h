@@ -33,5 +33,10 @@ void parse_hex_color(const char *hex, unsigned short *r, unsigned short *g,
                      unsigned short *b);
 int handleXError(Display *dpy, XErrorEvent *error);
 int run_command(const char *cmd, char *buf, size_t buflen);
+int mocha_cache_path(const char *name, char *buf, int len);
+int mocha_system(const char *cmd);
+void mocha_trap_errors();
+int mocha_untrap_errors();
+void mocha_commit();
 
 #endif  // MAIN_H
\ No newline at end of file
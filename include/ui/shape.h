@@ -0,0 +1,8 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <X11/Xlib.h>
+
+void mocha_shape_round_corners(Window win, int width, int height, int radius);
+
+#endif  // SHAPE_H
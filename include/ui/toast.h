@@ -17,13 +17,16 @@
 #define TOAST_HEIGHT 50
 #define TOAST_PADDING 5
 #define TOAST_TIMEOUT 2  // seconds
+#define TOAST_FRAME_MS 16
 
 typedef struct Toast {
     Window win;
     char message[256];
-    time_t created_at;
+    long long expires_at;  // monotonic ms
     int current_x;
     int target_x;
+    int current_y;
+    int target_y;
     int velocity;
     int alpha;
     struct Toast *next;
@@ -37,9 +40,12 @@ extern int screen;
 extern Toast *status_toast_ptr;
 extern Window quote_win;
 
-void cleanup_toasts();
+int cleanup_toasts();
 void show_toast(const char *message);
-void animate_toasts();
+int animate_toasts();
+int toast_timer_init();
+void toast_handle_timer(int fd, void *data);
+void schedule_toasts();
 void status_toast(const char *message);
 void show_quote_window(const char *quote);
 void update_quote_window(const char *quote);
@@ -6,12 +6,17 @@
 
 #define MAX_APPS 512
 
+/* Size icon paths are resolved for when the app table is built */
+#define APP_ICON_SIZE 64
+
+/* Strings point into the app table and are never NULL, "" when unset. An
+   entry with an empty name is a removed app and must be skipped */
 typedef struct {
-  char name[256];
-  char exec[256];
-  char icon[256];
-  char wm_class[256];
-  cairo_surface_t *icon_surface;
+  const char *name;
+  const char *exec;
+  const char *icon;
+  const char *wm_class;
+  const char *icon_path;
 } AppInfo;
 
 extern AppInfo apps[MAX_APPS];
@@ -20,6 +25,11 @@ extern bool apps_loaded;
 
 void find_applications();
 AppInfo *find_app_by_wmclass(const char *wm_class);
-void load_app_icon(AppInfo *app, int size);
+AppInfo *find_app_by_class(const char *wm_class);
+cairo_surface_t *load_app_icon(const AppInfo *app, int size);
+int mocha_apps_watch_init();
+int mocha_apps_load_async();
+void mocha_apps_handle_loaded(int fd, void *data);
+void mocha_apps_handle_watch(int fd, void *data);
 
 #endif // APP_H
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef APP_INDEX_H
+#define APP_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Directories scanned for .desktop files, in index order */
+#define APP_INDEX_DIRS 3
+
+/* One app, as offsets into the string table */
+typedef struct {
+    uint32_t name;
+    uint32_t exec;
+    uint32_t icon;
+    uint32_t wm_class;
+    uint32_t icon_path;
+    /* File name of the .desktop file, and which directory it is in */
+    uint32_t file;
+    uint32_t dir;
+} AppRecord;
+
+/* An app table, either mapped from the index file or freshly scanned */
+typedef struct {
+    const AppRecord *records;
+    uint32_t count;
+    const char *strings;
+    uint32_t strings_size;
+    /* Modification times of the scanned directories, 0 if missing */
+    int64_t dir_mtimes[APP_INDEX_DIRS];
+    /* Icon theme the icon paths were resolved with */
+    uint32_t icon_stamp;
+    /* Backing mapping, NULL for a scanned table */
+    void *map;
+    size_t map_size;
+} AppTable;
+
+int mocha_app_index_path(char *buf, int len);
+int mocha_app_index_load(const char *path,
+                         const int64_t dir_mtimes[APP_INDEX_DIRS],
+                         uint32_t icon_stamp, AppTable *out);
+int mocha_app_index_save(const char *path, const AppTable *table);
+void mocha_app_index_unmap(AppTable *table);
+
+#endif  // APP_INDEX_H
@@ -5,19 +5,19 @@
 #include <cairo/cairo-xlib.h>
 #include <cairo/cairo.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "main.h"
 #include "util/app.h"
 
-/* Maximum amount of clients to allow at once */
-#define MAX_CLIENTS 256
 /* Maximum number of dock icons */
 #define MAX_DOCK_ICONS 16
-/* Macro to iterate through all clients */
-#define mocha_for_each_client(cvar, wvar)                \
-    for(int __i = 0; __i < num_managed_clients; __i++) { \
-        Window wvar = managed_clients[__i];              \
-        ClientState *cvar = mocha_get_client_state(wvar);
+/* Macro to iterate through all clients, in the order they were managed */
+#define mocha_for_each_client(cvar, wvar)                       \
+    for(Client *__c = mocha_client_first(); __c;                \
+        __c = mocha_client_next(__c)) {                         \
+        Window wvar = __c->window;                              \
+        ClientState *cvar = &__c->state;
 #define mocha_for_each_client_end }
 
 /* Struct to keep track of client state */
@@ -27,22 +27,60 @@ typedef struct {
     int saved_x, saved_y, saved_w, saved_h;
 } ClientState;
 
+/* A managed window, lives in a stable slot until it is unmanaged */
+typedef struct Client {
+    Window window;
+    uint32_t slot;
+    /* Bumped every time the slot is freed */
+    uint32_t generation;
+    ClientState state;
+    /* Geometry cache, kept current from our own configure calls and from
+       ConfigureNotify/MapNotify/UnmapNotify */
+    int x, y, w, h, border;
+    int mapped;
+    int has_geometry;
+    /* Serial of our last configure request, older notifies are ignored */
+    unsigned long configure_serial;
+    /* Last rounded shape applied, see mocha_shape_round_corners() */
+    int has_shape;
+    int shape_w, shape_h, shape_radius;
+    /* Index into monitors[], the output this client is tiled on */
+    int monitor;
+    /* Interned res_class of WM_CLASS, NULL if unset */
+    const char *wm_class;
+    /* Index into dock_icons[] this client counts as running for, or -1 */
+    int dock_icon;
+    /* Workspace this client belongs to, and its neighbours there */
+    int workspace;
+    struct Client *ws_prev, *ws_next;
+    /* Managed order, as slot indices, -1 terminated */
+    int prev, next;
+} Client;
+
+/* Reference to a client that goes stale once the client is unmanaged */
+typedef struct {
+    uint32_t slot;
+    uint32_t generation;
+} ClientHandle;
+
 /* Struct for dock icons */
 typedef struct {
     char name[256];
     char command[256];
+    /* res_class of the app's windows, matched against StartupWMClass */
+    char wm_class[64];
     bool is_running;
+    /* Managed clients of this app */
+    int running_count;
+    /* Needs repainting into the dock back-buffer */
+    bool dirty;
     Window window;
     AppInfo *app;
     int x, y;
 } DockIcon;
 
-/* All client states */
-extern ClientState client_states[MAX_CLIENTS];
-/* 1 client state */
+/* 1 client state, NULL if the window is not managed */
 extern ClientState *mocha_get_client_state(Window w);
-/* All windows being managed */
-extern Window managed_clients[MAX_CLIENTS];
 /* Number of managed clients */
 extern int num_managed_clients;
 /* Dock icons */
@@ -50,17 +88,39 @@ extern DockIcon dock_icons[MAX_DOCK_ICONS];
 /* Number of dock icons */
 extern int num_dock_icons;
 
+Client *mocha_client_find(Window w);
+Client *mocha_client_add(Window w);
+void mocha_client_remove(Window w);
+Client *mocha_client_first();
+Client *mocha_client_next(Client *c);
+ClientHandle mocha_client_handle(const Client *c);
+Client *mocha_client_from_handle(ClientHandle h);
+
+void mocha_client_fetch_geometry(Client *c);
+void mocha_client_fetch_class(Client *c);
+void mocha_client_move_resize(Client *c, int x, int y, int w, int h);
+void mocha_client_move(Client *c, int x, int y);
+void mocha_client_resize(Client *c, int w, int h);
+void mocha_client_set_border(Client *c, int border);
+void mocha_client_track_event(const XEvent *e);
+void mocha_client_verify_geometry();
+
 void mocha_add_managed_client(Window w);
 void mocha_remove_managed_client(Window w);
-void mocha_tile_clients(int taskbar_height);
+int mocha_tile_monitor(int monitor, int taskbar_height);
+void mocha_request_retile_monitor(int monitor);
+void mocha_request_retile_client(const Client *c);
+void mocha_request_retile();
+void mocha_flush_retile(int taskbar_height, int tiling_enabled);
 char *mocha_get_client_name(Window w);
 int is_dialog(Window w);
 void mocha_init_dock();
-void mocha_add_dock_icon(const char *name, const char *command);
+void mocha_add_dock_icon(const char *name, const char *command,
+                         const char *wm_class);
+void mocha_dock_bind_apps();
 void mocha_draw_dock(Window dock_win);
+void mocha_dock_expose(Window dock_win, const XExposeEvent *e);
 void mocha_handle_dock_click(int x, int y);
-void mocha_update_dock_icons();
-void mocha_draw_wallpaper(cairo_surface_t *surface, const char *filename,
-                          int width, int height);
+void mocha_dock_track_client(Client *c, int delta);
 
 #endif  // CLIENT_H
@@ -26,6 +26,13 @@ struct ConfigFeatures {
     int tiling_enabled;
     int quotes_enabled;
     int border_radius;
+    int debug_roundtrips;
+    int debug_geometry;
+    char volume_backend[32];
+    char layout[32];
+    int workspaces;
+    char icon_theme[64];
+    int icon_cache_kb;
 };
 
 struct Config {
@@ -0,0 +1,35 @@
+#ifndef DESKTOP_ENTRY_H
+#define DESKTOP_ENTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A raw value inside a mapped .desktop file, still escaped */
+typedef struct {
+    const char *ptr;
+    size_t len;
+} DesktopValue;
+
+/* The [Desktop Entry] group of a .desktop file. Values point into the
+   file data and stay valid until mocha_desktop_entry_close() or the next
+   mocha_desktop_entry_open() on the same thread */
+typedef struct {
+    DesktopValue name;
+    DesktopValue exec;
+    DesktopValue icon;
+    DesktopValue wm_class;
+    bool no_display;
+    bool hidden;
+    /* False for Type=Link or Type=Directory entries */
+    bool is_application;
+    void *map;
+    size_t map_size;
+} DesktopEntry;
+
+bool mocha_desktop_entry_open(const char *path, DesktopEntry *entry);
+void mocha_desktop_entry_close(DesktopEntry *entry);
+void mocha_desktop_entry_parse(const char *data, size_t len,
+                               DesktopEntry *entry);
+size_t mocha_desktop_value_unescape(DesktopValue value, bool exec, char *out);
+
+#endif  // DESKTOP_ENTRY_H
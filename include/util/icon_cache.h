@@ -0,0 +1,20 @@
+#ifndef ICON_CACHE_H
+#define ICON_CACHE_H
+
+#include <cairo/cairo.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Budget used when the config does not set one */
+#define ICON_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+void mocha_icon_cache_set_budget(size_t bytes);
+cairo_surface_t *mocha_icon_cache_get(const char *path, int size);
+int mocha_icon_cache_async_fd();
+cairo_surface_t *mocha_icon_cache_request(const char *path, int size,
+                                          bool *pending);
+int mocha_icon_cache_collect();
+void mocha_icon_cache_drop_size(int size);
+void mocha_icon_cache_clear();
+
+#endif  // ICON_CACHE_H
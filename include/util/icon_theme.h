@@ -0,0 +1,13 @@
+#ifndef ICON_THEME_H
+#define ICON_THEME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void mocha_icon_theme_init(const char *theme);
+uint32_t mocha_icon_theme_stamp();
+bool mocha_icon_theme_lookup(const char *name, int size, char *path,
+                             size_t len);
+
+#endif  // ICON_THEME_H
@@ -0,0 +1,10 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+/* Interned strings live until exit. Equal strings share one pointer, so
+   they can be compared and hashed by address */
+const char *mocha_intern(const char *s);
+/* Interned copy of s, or NULL if s was never interned */
+const char *mocha_intern_find(const char *s);
+
+#endif  // INTERN_H
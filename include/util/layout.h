@@ -0,0 +1,26 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "util/client.h"
+
+typedef struct {
+    int x, y, w, h;
+} MochaRect;
+
+/* A tiling layout, fills out[0..n-1] with outer rectangles (borders
+   included) for n windows inside area */
+typedef struct {
+    const char *name;
+    void (*arrange)(const MochaRect *area, int n, int gap, MochaRect *out);
+} Layout;
+
+extern const Layout layout_master_stack;
+extern const Layout layout_grid;
+extern const Layout layout_monocle;
+
+const Layout *mocha_layout_by_name(const char *name);
+const Layout *mocha_layout_next(const Layout *current);
+int mocha_layout_apply(const Layout *layout, const MochaRect *area, int gap,
+                       Client **clients, int n);
+
+#endif  // LAYOUT_H
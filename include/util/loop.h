@@ -0,0 +1,14 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+/* Maximum number of file descriptors the main loop can watch */
+#define MAX_LOOP_FDS 16
+
+typedef void (*MochaLoopCallback)(int fd, void *data);
+
+int mocha_loop_add_fd(int fd, MochaLoopCallback callback, void *data);
+void mocha_loop_remove_fd(int fd);
+void mocha_loop_run(void (*dispatch_x)(void *data), void *data);
+void mocha_loop_quit();
+
+#endif  // LOOP_H
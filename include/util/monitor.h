@@ -0,0 +1,29 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <X11/Xlib.h>
+
+#include "util/client.h"
+#include "util/layout.h"
+
+#define MAX_MONITORS 8
+
+/* One output region, tiled independently of the others. Monitor 0 is the
+   primary output and holds the taskbar */
+typedef struct {
+    int x, y, w, h;
+    const Layout *layout;
+    /* Needs a layout pass at the end of the current event batch */
+    int dirty;
+} Monitor;
+
+extern Monitor monitors[MAX_MONITORS];
+extern int num_monitors;
+
+void mocha_monitor_init(const Layout *layout);
+int mocha_monitor_handle_event(XEvent *e);
+int mocha_monitor_at(int x, int y);
+int mocha_monitor_of_client(const Client *c);
+Monitor *mocha_monitor_under_pointer();
+
+#endif  // MONITOR_H
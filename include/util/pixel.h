@@ -0,0 +1,26 @@
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86 1
+#endif
+
+/* x * a / 255 rounded, exact for every 8 bit x and a */
+static inline uint32_t mocha_pixel_mul_div255(uint32_t x, uint32_t a) {
+    return ((x * a + 128) * 257) >> 16;
+}
+
+void mocha_pixel_rgba_to_argb32(uint8_t *data, size_t count);
+
+/* The kernels behind mocha_pixel_rgba_to_argb32(), for tests and
+   benchmarks. The SIMD ones need the matching CPU feature */
+void mocha_pixel_rgba_to_argb32_scalar(uint8_t *data, size_t count);
+#ifdef PIXEL_X86
+void mocha_pixel_rgba_to_argb32_sse2(uint8_t *data, size_t count);
+void mocha_pixel_rgba_to_argb32_avx2(uint8_t *data, size_t count);
+#endif
+
+#endif  // PIXEL_H
@@ -0,0 +1,12 @@
+#ifndef POINTER_H
+#define POINTER_H
+
+#include <X11/Xlib.h>
+
+void mocha_stack_init();
+void mocha_pointer_track_event(const XEvent *e);
+void mocha_pointer_invalidate();
+Window mocha_pointer_window();
+void mocha_pointer_position(int *x, int *y);
+
+#endif  // POINTER_H
@@ -0,0 +1,33 @@
+#ifndef SHM_IMAGE_H
+#define SHM_IMAGE_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <cairo/cairo.h>
+#include <stdbool.h>
+
+/* Client side pixels cairo draws into and the server reads from, through
+   a MIT-SHM segment when the server shares memory with us, otherwise
+   copied over the socket */
+typedef struct {
+    XImage *ximage;
+    XShmSegmentInfo shm;
+    /* Image surface over ximage->data */
+    cairo_surface_t *surface;
+    int width, height;
+    bool shared;
+    /* Shared puts the server may still be reading from */
+    int pending;
+} ShmImage;
+
+bool mocha_shm_available();
+void mocha_shm_disable();
+bool mocha_shm_image_create(ShmImage *img, Visual *visual, int depth,
+                            int width, int height);
+void mocha_shm_image_destroy(ShmImage *img);
+void mocha_shm_image_wait(ShmImage *img);
+void mocha_shm_image_put(ShmImage *img, Drawable d, GC gc, int x, int y,
+                         int w, int h);
+int mocha_shm_image_handle_event(XEvent *e);
+
+#endif  // SHM_IMAGE_H
@@ -0,0 +1,11 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <spawn.h>
+#include <sys/types.h>
+
+void mocha_spawn_attr_init(posix_spawnattr_t *attr, int detach);
+pid_t mocha_spawn(const char *cmd);
+void mocha_spawn_reap();
+
+#endif  // SPAWN_H
@@ -0,0 +1,50 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <X11/X.h>
+
+/* Runtime counters, dumped with mocha_stats_log() */
+struct MochaStats {
+    /* MotionNotify events read from the queue */
+    unsigned long motion_events;
+    /* MotionNotify events dropped by drag/resize coalescing */
+    unsigned long motion_coalesced;
+    /* Event batches committed by the main loop */
+    unsigned long batches;
+    /* Retile requests folded into an already pending one */
+    unsigned long retiles_coalesced;
+    /* Layout passes and windows reconfigured by them */
+    unsigned long layout_passes;
+    unsigned long layout_windows_touched;
+    /* Busiest second seen, in layout passes */
+    unsigned long layout_passes_peak;
+    /* Launcher opens, time from opening to the first painted frame and
+       to the last visible icon arriving, in milliseconds */
+    unsigned long launcher_opens;
+    double launcher_first_frame_ms, launcher_first_frame_max_ms;
+    double launcher_first_frame_total_ms;
+    double launcher_filled_ms;
+    /* Client side images sent through MIT-SHM and over the socket */
+    unsigned long shm_puts, shm_put_bytes;
+    unsigned long image_puts, image_put_bytes;
+
+    /* Round trip accounting, only filled in when debug_roundtrips is set */
+    int debug_roundtrips;
+    /* Event type being dispatched, 0 between batches */
+    int current_event;
+    unsigned long events[LASTEvent];
+    unsigned long roundtrips[LASTEvent];
+};
+
+extern struct MochaStats mocha_stats;
+
+void mocha_stats_init();
+void mocha_stats_begin_event(int type);
+void mocha_stats_layout_pass(int windows_touched);
+void mocha_stats_roundtrip();
+double mocha_stats_now_ms();
+void mocha_stats_launcher_frame(double first_frame_ms);
+void mocha_stats_launcher_filled(double filled_ms);
+void mocha_stats_log();
+
+#endif  // STATS_H
@@ -0,0 +1,9 @@
+#ifndef WALLPAPER_H
+#define WALLPAPER_H
+
+int mocha_wallpaper_init(const char *path, const char *mode, int width,
+                         int height);
+void mocha_wallpaper_handle_loaded(int fd, void *data);
+void mocha_wallpaper_free();
+
+#endif  // WALLPAPER_H
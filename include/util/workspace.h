@@ -0,0 +1,30 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "util/client.h"
+
+#define MAX_WORKSPACES 9
+
+/* A set of clients shown together. Hidden workspaces keep their clients'
+   geometry, so showing one again needs no layout pass unless something
+   changed while it was hidden */
+typedef struct {
+    Client *first, *last;
+    int count;
+    /* Monitors needing a layout pass once this workspace is shown */
+    unsigned int dirty;
+} Workspace;
+
+extern Workspace workspaces[MAX_WORKSPACES];
+extern int num_workspaces;
+extern int current_workspace;
+
+void mocha_workspace_init(int count);
+void mocha_workspace_attach(Client *c, int ws);
+void mocha_workspace_detach(Client *c);
+void mocha_workspace_switch(int ws);
+void mocha_workspace_move_client(Client *c, int ws);
+void mocha_workspace_invalidate(unsigned int monitor_mask);
+void mocha_workspace_remap_monitors(const int *old_to_new, int old_count);
+
+#endif  // WORKSPACE_H
@@ -3,7 +3,6 @@
 #include <X11/XF86keysym.h>
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib.h>
-#include <X11/extensions/shape.h>
 #include <X11/keysym.h>
 #include <cairo/cairo-xlib.h>
 #include <cairo/cairo.h>
@@ -12,10 +11,18 @@
 #include <string.h>
 
 #include "features/launcher.h"
+#include "features/volume.h"
 #include "main.h"
+#include "ui/shape.h"
 #include "ui/toast.h"
 #include "util/client.h"
 #include "util/config.h"
+#include "util/layout.h"
+#include "util/monitor.h"
+#include "util/pointer.h"
+#include "util/spawn.h"
+#include "util/stats.h"
+#include "util/workspace.h"
 
 extern int screen;
 extern Display *dpy;
@@ -25,59 +32,54 @@ extern unsigned long border_color, focus_color, panel_color, foreground_color,
 extern Window quote_win;
 
 void update_window_borders(Window focused);
-static void round_corners(Window win, int width, int height, int radius);
 
 static void minimize_window(Window w) {
-    ClientState *state = mocha_get_client_state(w);
-    if(!state->is_minimized) {
+    Client *c = mocha_client_find(w);
+    if(c && !c->state.is_minimized) {
         XUnmapWindow(dpy, w);
-        state->is_minimized = 1;
+        c->state.is_minimized = 1;
+        mocha_request_retile_client(c);
     }
 }
 
 static void restore_window(Window w) {
-    ClientState *state = mocha_get_client_state(w);
-    if(state->is_minimized) {
+    Client *c = mocha_client_find(w);
+    if(c && c->state.is_minimized) {
         XMapWindow(dpy, w);
         XRaiseWindow(dpy, w);
         XSetInputFocus(dpy, w, RevertToPointerRoot, CurrentTime);
-        state->is_minimized = 0;
+        c->state.is_minimized = 0;
+        mocha_request_retile_client(c);
     }
 }
 
 static void toggle_maximize_window(Window w) {
-    ClientState *state = mocha_get_client_state(w);
+    Client *c = mocha_client_find(w);
     int border = get_border_width();
+    if(!c) return;
+    ClientState *state = &c->state;
     if(state->is_fullscreen) {
-        XMoveResizeWindow(dpy, w, state->saved_x, state->saved_y,
-                          state->saved_w, state->saved_h);
+        mocha_client_move_resize(c, state->saved_x, state->saved_y,
+                                 state->saved_w, state->saved_h);
         state->is_fullscreen = 0;
-        round_corners(w, state->saved_w, state->saved_h,
-                      config.features.border_radius);
+        mocha_shape_round_corners(w, state->saved_w, state->saved_h,
+                                  config.features.border_radius);
     } else {
-        XWindowAttributes attr;
-        XGetWindowAttributes(dpy, w, &attr);
-        state->saved_x = attr.x;
-        state->saved_y = attr.y;
-        state->saved_w = attr.width;
-        state->saved_h = attr.height;
-        int screen_w = DisplayWidth(dpy, screen);
-        int screen_h = DisplayHeight(dpy, screen);
-        XMoveResizeWindow(dpy, w, 0, 0, screen_w - 2 * border,
-                          screen_h - 2 * border);
+        state->saved_x = c->x;
+        state->saved_y = c->y;
+        state->saved_w = c->w;
+        state->saved_h = c->h;
+        const Monitor *mon = &monitors[c->monitor];
+        mocha_client_move_resize(c, mon->x, mon->y, mon->w - 2 * border,
+                                 mon->h - 2 * border);
         state->is_fullscreen = 1;
-        round_corners(w, screen_w - 2 * border, screen_h - 2 * border, 0);
+        mocha_shape_round_corners(w, mon->w - 2 * border, mon->h - 2 * border,
+                                  0);
     }
+    mocha_request_retile_client(c);
     update_window_borders(w);
 }
 
-static int is_managed_client(Window w) {
-    for(int i = 0; i < num_managed_clients; ++i) {
-        if(managed_clients[i] == w) return 1;
-    }
-    return 0;
-}
-
 void update_window_borders(Window focused) {
     ClientState *c;
     Window w;
@@ -91,132 +93,84 @@ void update_window_borders(Window focused) {
     mocha_for_each_client_end
 }
 
-static void round_corners(Window win, int width, int height, int radius) {
-    if(radius <= 0) {
-        XShapeCombineMask(dpy, win, ShapeBounding, 0, 0, None, ShapeSet);
-        return;
-    }
-
-    Pixmap shape_mask = XCreatePixmap(dpy, win, width, height, 1);
-    if(shape_mask == None) {
-        return;
-    }
-
-    GC gc = XCreateGC(dpy, shape_mask, 0, NULL);
-    if(gc == NULL) {
-        XFreePixmap(dpy, shape_mask);
-        return;
-    }
-
-    XSetForeground(dpy, gc, 0);
-    XFillRectangle(dpy, shape_mask, gc, 0, 0, width, height);
-
-    XSetForeground(dpy, gc, 1);
-    XFillArc(dpy, shape_mask, gc, 0, 0, 2 * radius, 2 * radius, 90 * 64,
-             90 * 64);
-    XFillArc(dpy, shape_mask, gc, width - 2 * radius - 1, 0, 2 * radius,
-             2 * radius, 0 * 64, 90 * 64);
-    XFillArc(dpy, shape_mask, gc, 0, height - 2 * radius - 1, 2 * radius,
-             2 * radius, 180 * 64, 90 * 64);
-    XFillArc(dpy, shape_mask, gc, width - 2 * radius - 1,
-             height - 2 * radius - 1, 2 * radius, 2 * radius, 270 * 64,
-             90 * 64);
-
-    XFillRectangle(dpy, shape_mask, gc, radius, 0, width - 2 * radius, height);
-    XFillRectangle(dpy, shape_mask, gc, 0, radius, width, height - 2 * radius);
-
-    XShapeCombineMask(dpy, win, ShapeBounding, 0, 0, shape_mask, ShapeSet);
-
-    XFreeGC(dpy, gc);
-    XFreePixmap(dpy, shape_mask);
-}
-
-static void show_volume_toast() {
-    char buf[128];
-    if(run_command(
-           "pactl get-sink-volume @DEFAULT_SINK@ | grep -o '[0-9]*%' | head -1",
-           buf, sizeof(buf)) == 0 &&
-       strlen(buf) > 0) {
-        char msg[64];
-        snprintf(msg, sizeof(msg), "Volume: %s", buf);
-        size_t len = strlen(msg);
-        if(len > 0 && msg[len - 1] == '\n') msg[len - 1] = '\0';
-        show_toast(msg);
-        return;
-    }
-    show_toast("Volume: ?");
-}
-
 void mocha_handle_event(XEvent event, Window taskbar,
                         struct DragState *drag_state, int taskbar_height,
                         int tiling_enabled) {
+    mocha_pointer_track_event(&event);
+
     switch(event.type) {
         case ButtonPress: {
             XButtonEvent *e = &event.xbutton;
-            Window child;
-            int root_x, root_y, win_rel_x, win_rel_y;
-            unsigned int mask;
-
-            if(XQueryPointer(dpy, root, &root, &child, &root_x, &root_y,
-                             &win_rel_x, &win_rel_y, &mask)) {
-                if(child != None && is_managed_client(child)) {
-                    XWindowAttributes attr;
-                    XGetWindowAttributes(dpy, child, &attr);
-                    drag_state->active_window = child;
-                    drag_state->start_x = e->x_root;
-                    drag_state->start_y = e->y_root;
-                    drag_state->win_x = attr.x;
-                    drag_state->win_y = attr.y;
-                    drag_state->win_w = attr.width;
-                    drag_state->win_h = attr.height;
-
-                    if((e->state & Mod1Mask) && e->button == Button1) {
-                        drag_state->dragging = True;
-                    } else if((e->state & Mod1Mask) && e->button == Button3) {
-                        drag_state->resizing = True;
-                    }
-                } else {
-                    drag_state->active_window = None;
+            Window child = mocha_pointer_window();
+            Client *c = child != None ? mocha_client_find(child) : NULL;
+            if(c) {
+                drag_state->active_window = child;
+                drag_state->start_x = e->x_root;
+                drag_state->start_y = e->y_root;
+                drag_state->win_x = c->x;
+                drag_state->win_y = c->y;
+                drag_state->win_w = c->w;
+                drag_state->win_h = c->h;
+
+                if((e->state & Mod1Mask) && e->button == Button1) {
+                    drag_state->dragging = True;
+                } else if((e->state & Mod1Mask) && e->button == Button3) {
+                    drag_state->resizing = True;
                 }
+            } else {
+                drag_state->active_window = None;
             }
 
             if(event.xbutton.window == taskbar) {
+                int ws = current_workspace;
                 mocha_handle_dock_click(event.xbutton.x, event.xbutton.y);
+                if(ws != current_workspace) mocha_draw_dock(taskbar);
             }
 
             XAllowEvents(dpy, ReplayPointer, CurrentTime);
             break;
         }
 
-        case ButtonRelease:
+        case ButtonRelease: {
+            Client *c = drag_state->dragging
+                            ? mocha_client_find(drag_state->active_window)
+                            : NULL;
+            /* A window dropped on another monitor is tiled there */
+            if(c) {
+                int monitor = mocha_monitor_of_client(c);
+                if(monitor != c->monitor) {
+                    mocha_request_retile_monitor(c->monitor);
+                    c->monitor = monitor;
+                    mocha_request_retile_monitor(monitor);
+                }
+            }
             drag_state->dragging = 0;
             drag_state->resizing = 0;
             break;
+        }
 
         case MotionNotify: {
-            if(drag_state->active_window != None &&
-               is_managed_client(drag_state->active_window)) {
+            Client *c = drag_state->active_window != None
+                            ? mocha_client_find(drag_state->active_window)
+                            : NULL;
+            if(c) {
                 int dx = event.xmotion.x_root - drag_state->start_x;
                 int dy = event.xmotion.y_root - drag_state->start_y;
 
                 if(drag_state->dragging) {
-                    XMoveWindow(dpy, drag_state->active_window,
-                                drag_state->win_x + dx, drag_state->win_y + dy);
+                    mocha_client_move(c, drag_state->win_x + dx,
+                                      drag_state->win_y + dy);
                 } else if(drag_state->resizing) {
-                    XResizeWindow(
-                        dpy, drag_state->active_window,
-                        drag_state->win_w + dx > 50 ? drag_state->win_w + dx
-                                                    : 50,
-                        drag_state->win_h + dy > 50 ? drag_state->win_h + dy
-                                                    : 50);
                     int new_width = drag_state->win_w + dx > 50
                                         ? drag_state->win_w + dx
                                         : 50;
                     int new_height = drag_state->win_h + dy > 50
                                          ? drag_state->win_h + dy
                                          : 50;
-                    round_corners(drag_state->active_window, new_width,
-                                  new_height, config.features.border_radius);
+                    mocha_client_resize(c, new_width, new_height);
+                    mocha_shape_round_corners(drag_state->active_window,
+                                              new_width, new_height,
+                                              config.features.border_radius);
                 }
             }
             break;
@@ -224,26 +178,41 @@ void mocha_handle_event(XEvent event, Window taskbar,
 
         case KeyPress: {
             KeySym keysym = XLookupKeysym(&event.xkey, 0);
-            Window focused;
-            int revert;
-            XGetInputFocus(dpy, &focused, &revert);
-            Window mouse_win = None;
-            int rx, ry, wx, wy;
-            unsigned int mask;
-            if(XQueryPointer(dpy, root, &root, &mouse_win, &rx, &ry, &wx, &wy,
-                             &mask)) {
-                if(mouse_win == None || mouse_win == root) mouse_win = focused;
-            } else {
-                mouse_win = focused;
+            Window mouse_win = mocha_pointer_window();
+            if(mouse_win == None || mouse_win == root) {
+                int revert;
+                mocha_stats_roundtrip();
+                XGetInputFocus(dpy, &mouse_win, &revert);
             }
             if((event.xkey.state & Mod1Mask) && keysym == XK_0) {
                 mocha_shutdown();
             } else if((event.xkey.state & Mod1Mask) && keysym == XK_q) {
-                system("ghostty &");
+                mocha_spawn("ghostty");
             } else if((event.xkey.state & Mod1Mask) && keysym == XK_c) {
-                system("chromium &");
+                mocha_spawn("chromium");
             } else if((event.xkey.state & Mod1Mask) && keysym == XK_z) {
                 mocha_launch_menu();
+            } else if((event.xkey.state & Mod1Mask) && keysym == XK_space) {
+                Monitor *mon = mocha_monitor_under_pointer();
+                mon->layout = mocha_layout_next(mon->layout);
+                char msg[64];
+                snprintf(msg, sizeof(msg), "Layout: %s", mon->layout->name);
+                show_toast(msg);
+                mocha_request_retile_monitor(mon - monitors);
+                mocha_workspace_invalidate(1u << (mon - monitors));
+            } else if((event.xkey.state & Mod1Mask) && keysym >= XK_1 &&
+                      keysym <= XK_9) {
+                int ws = keysym - XK_1;
+                Client *c = (event.xkey.state & ShiftMask) &&
+                                    mouse_win != None &&
+                                    mouse_win != PointerRoot
+                                ? mocha_client_find(mouse_win)
+                                : NULL;
+                if(c)
+                    mocha_workspace_move_client(c, ws);
+                else
+                    mocha_workspace_switch(ws);
+                mocha_draw_dock(taskbar);
             } else if((event.xkey.state & Mod1Mask) && keysym == XK_f &&
                       mouse_win != None && mouse_win != PointerRoot) {
                 toggle_maximize_window(mouse_win);
@@ -254,20 +223,11 @@ void mocha_handle_event(XEvent event, Window taskbar,
                       mouse_win != None && mouse_win != PointerRoot) {
                 minimize_window(mouse_win);
             } else if(keysym == XF86XK_AudioRaiseVolume) {
-                system(
-                    "pactl set-sink-volume "
-                    "@DEFAULT_SINK@ +5% > /dev/null");
-                show_volume_toast();
+                mocha_volume_adjust(5);
             } else if(keysym == XF86XK_AudioLowerVolume) {
-                system(
-                    "pactl set-sink-volume "
-                    "@DEFAULT_SINK@ -5% > /dev/null");
-                show_volume_toast();
+                mocha_volume_adjust(-5);
             } else if(keysym == XF86XK_AudioMute) {
-                system(
-                    "pactl set-sink-mute "
-                    "@DEFAULT_SINK@ toggle > /dev/null");
-                show_volume_toast();
+                mocha_volume_toggle_mute();
             }
             break;
         }
@@ -276,23 +236,32 @@ void mocha_handle_event(XEvent event, Window taskbar,
             XMapRequestEvent *e = &event.xmaprequest;
 
             if(is_dialog(e->window)) {
-                system("thunar &");
+                mocha_spawn("thunar");
                 XDestroyWindow(dpy, e->window);
                 break;
             }
 
-            mocha_add_managed_client(e->window);
-            XSetWindowBorderWidth(dpy, e->window, get_border_width());
+            Client *c = mocha_client_find(e->window);
+            int is_new = !c;
+            if(is_new) c = mocha_client_add(e->window);
+            if(!c) break;
+            if(!c->has_geometry) mocha_client_fetch_geometry(c);
+            mocha_client_set_border(c, get_border_width());
             XSetWindowBorder(dpy, e->window, border_color);
-            if(tiling_enabled) mocha_tile_clients(taskbar_height);
+            /* New windows open on the monitor the user is looking at */
+            if(is_new) {
+                c->monitor = mocha_monitor_under_pointer() - monitors;
+                mocha_client_fetch_class(c);
+                mocha_dock_track_client(c, 1);
+            }
+            /* A window mapping itself is brought to the current workspace */
+            mocha_workspace_move_client(c, current_workspace);
             XMapWindow(dpy, e->window);
-            XWindowAttributes attr;
-            XGetWindowAttributes(dpy, e->window, &attr);
-            round_corners(e->window, attr.width, attr.height,
-                          config.features.border_radius);
+            mocha_shape_round_corners(e->window, c->w, c->h,
+                                      config.features.border_radius);
             XSetInputFocus(dpy, e->window, RevertToPointerRoot, CurrentTime);
             XSetWindowBorder(dpy, e->window, focus_color);
-            mocha_update_dock_icons();
+            mocha_draw_dock(taskbar);
             break;
         }
 
@@ -306,10 +275,19 @@ void mocha_handle_event(XEvent event, Window taskbar,
             changes.border_width = get_border_width();
             changes.sibling = e->above;
             changes.stack_mode = e->detail;
+            Client *c = mocha_client_find(e->window);
+            if(c) {
+                c->configure_serial = NextRequest(dpy);
+                if(e->value_mask & CWX) c->x = e->x;
+                if(e->value_mask & CWY) c->y = e->y;
+                if(e->value_mask & CWWidth) c->w = e->width;
+                if(e->value_mask & CWHeight) c->h = e->height;
+                c->border = changes.border_width;
+            }
             XConfigureWindow(dpy, e->window, e->value_mask | CWBorderWidth,
                              &changes);
-            round_corners(e->window, e->width, e->height,
-                          config.features.border_radius);
+            mocha_shape_round_corners(e->window, e->width, e->height,
+                                      config.features.border_radius);
             break;
         }
 
@@ -330,11 +308,10 @@ void mocha_handle_event(XEvent event, Window taskbar,
                     expose_event.xexpose.window = quote_win;
                     XSendEvent(dpy, quote_win, False, ExposureMask,
                                &expose_event);
-                    XFlush(dpy);
                 }
                 break;
             } else if(event.xexpose.window == taskbar) {
-                mocha_draw_dock(taskbar);
+                mocha_dock_expose(taskbar, &event.xexpose);
             } else if(quote_win && event.xexpose.window == quote_win) {
                 draw_quote_window();
             } else {
@@ -410,20 +387,25 @@ void mocha_handle_event(XEvent event, Window taskbar,
 
         case DestroyNotify: {
             XDestroyWindowEvent *e = &event.xdestroywindow;
-            mocha_remove_managed_client(e->window);
-            if(tiling_enabled) mocha_tile_clients(taskbar_height);
-            XEvent expose_event;
-            expose_event.type = Expose;
-            expose_event.xexpose.window = taskbar;
-            XSendEvent(dpy, taskbar, False, ExposureMask, &expose_event);
-            XFlush(dpy);
-            mocha_update_dock_icons();
+            Client *c = mocha_client_find(e->window);
+            if(c) {
+                mocha_request_retile_client(c);
+                mocha_dock_track_client(c, -1);
+                mocha_remove_managed_client(e->window);
+                mocha_draw_dock(taskbar);
+            }
             break;
         }
 
+        case ConfigureNotify:
+        case MapNotify:
+        case UnmapNotify:
+            mocha_client_track_event(&event);
+            break;
+
         default:
             break;
     }
 
-    XSync(dpy, 0);
+    if(config.features.debug_geometry) mocha_client_verify_geometry();
 }
@@ -4,8 +4,13 @@
 #include <stdlib.h>
 
 #include "mocha_launcher.h"
+#include "util/pointer.h"
 
 extern Display* dpy;
 extern int screen;
 
-void mocha_launch_menu() { show_launcher(dpy, screen); }
+void mocha_launch_menu() {
+    show_launcher(dpy, screen);
+    /* The launcher ran its own event loop, our mirrors missed those events */
+    mocha_pointer_invalidate();
+}
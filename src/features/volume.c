@@ -0,0 +1,196 @@
+#include "features/volume.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "ui/toast.h"
+
+/*
+ * Volume keys only record what they want; a worker thread talks to the
+ * backend. Presses that arrive while the worker is busy are folded into a
+ * single delta, and the resulting state is posted back to the main loop
+ * through an eventfd.
+ */
+
+static const VolumeBackend *backend = NULL;
+static pthread_t worker;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int result_fd = -1;
+
+/* Requests, protected by lock */
+static int pending_delta = 0;
+static int pending_mute_toggles = 0;
+static int pending = 0;
+
+/* Latest result, protected by lock */
+static int result_ok = 0;
+static int result_percent = 0;
+static int result_muted = 0;
+
+static int pactl_adjust(int delta) {
+    char cmd[96];
+    snprintf(cmd, sizeof(cmd),
+             "pactl set-sink-volume @DEFAULT_SINK@ %+d%% > /dev/null", delta);
+    return mocha_system(cmd) == 0 ? 0 : -1;
+}
+
+static int pactl_toggle_mute() {
+    return mocha_system("pactl set-sink-mute @DEFAULT_SINK@ toggle > "
+                        "/dev/null") == 0
+               ? 0
+               : -1;
+}
+
+static int pactl_query(int *percent, int *muted) {
+    char buf[512];
+    if(run_command("pactl get-sink-volume @DEFAULT_SINK@", buf,
+                   sizeof(buf)) != 0)
+        return -1;
+    /* "Volume: front-left: 32768 /  50% / ..." */
+    char *pct = strchr(buf, '%');
+    if(!pct) return -1;
+    char *start = pct;
+    while(start > buf && start[-1] >= '0' && start[-1] <= '9') start--;
+    if(start == pct) return -1;
+    *percent = atoi(start);
+
+    *muted = 0;
+    if(run_command("pactl get-sink-mute @DEFAULT_SINK@", buf, sizeof(buf)) ==
+       0)
+        *muted = strstr(buf, "yes") != NULL;
+    return 0;
+}
+
+const VolumeBackend volume_backend_pactl = {
+    .name = "pactl",
+    .adjust = pactl_adjust,
+    .toggle_mute = pactl_toggle_mute,
+    .query = pactl_query,
+};
+
+/* In-memory backend for running without an audio server */
+static int stub_percent = 50;
+static int stub_muted = 0;
+
+static int stub_adjust(int delta) {
+    stub_percent += delta;
+    if(stub_percent < 0) stub_percent = 0;
+    if(stub_percent > 150) stub_percent = 150;
+    return 0;
+}
+
+static int stub_toggle_mute() {
+    stub_muted = !stub_muted;
+    return 0;
+}
+
+static int stub_query(int *percent, int *muted) {
+    *percent = stub_percent;
+    *muted = stub_muted;
+    return 0;
+}
+
+const VolumeBackend volume_backend_stub = {
+    .name = "stub",
+    .adjust = stub_adjust,
+    .toggle_mute = stub_toggle_mute,
+    .query = stub_query,
+};
+
+/**
+ * Look up a backend by its config name, defaults to pactl
+ */
+const VolumeBackend *mocha_volume_backend_by_name(const char *name) {
+    if(name && strcmp(name, volume_backend_stub.name) == 0)
+        return &volume_backend_stub;
+    return &volume_backend_pactl;
+}
+
+static void *volume_worker(void *arg) {
+    for(;;) {
+        pthread_mutex_lock(&lock);
+        while(!pending) pthread_cond_wait(&wake, &lock);
+        int delta = pending_delta;
+        int toggles = pending_mute_toggles;
+        pending_delta = pending_mute_toggles = pending = 0;
+        pthread_mutex_unlock(&lock);
+
+        if(toggles % 2) backend->toggle_mute();
+        if(delta) backend->adjust(delta);
+        int percent = 0, muted = 0;
+        int ok = backend->query(&percent, &muted) == 0;
+
+        pthread_mutex_lock(&lock);
+        result_ok = ok;
+        result_percent = percent;
+        result_muted = muted;
+        pthread_mutex_unlock(&lock);
+
+        uint64_t one = 1;
+        if(write(result_fd, &one, sizeof(one)) < 0) perror("volume write");
+    }
+    return NULL;
+}
+
+/**
+ * Start the volume worker, returns the eventfd to watch for results
+ */
+int mocha_volume_init(const VolumeBackend *volume_backend) {
+    backend = volume_backend;
+    result_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(result_fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    if(pthread_create(&worker, NULL, volume_worker, NULL) != 0) {
+        mocha_log("Volume] Failed to start worker thread");
+        close(result_fd);
+        result_fd = -1;
+        return -1;
+    }
+    pthread_detach(worker);
+    mocha_log("Volume] Using %s backend", backend->name);
+    return result_fd;
+}
+
+static void queue_request(int delta, int toggles) {
+    if(result_fd < 0) return;
+    pthread_mutex_lock(&lock);
+    pending_delta += delta;
+    pending_mute_toggles += toggles;
+    pending = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void mocha_volume_adjust(int delta) { queue_request(delta, 0); }
+
+void mocha_volume_toggle_mute() { queue_request(0, 1); }
+
+/**
+ * Main loop callback, shows the latest state posted by the worker
+ */
+void mocha_volume_handle_result(int fd, void *data) {
+    uint64_t count;
+    if(read(fd, &count, sizeof(count)) < 0) return;
+
+    pthread_mutex_lock(&lock);
+    int ok = result_ok, percent = result_percent, muted = result_muted;
+    pthread_mutex_unlock(&lock);
+
+    char msg[64];
+    if(!ok)
+        snprintf(msg, sizeof(msg), "Volume: ?");
+    else if(muted)
+        snprintf(msg, sizeof(msg), "Volume: %d%% (muted)", percent);
+    else
+        snprintf(msg, sizeof(msg), "Volume: %d%%", percent);
+    show_toast(msg);
+}
@@ -16,15 +16,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "event/event.h"
 #include "features/launcher.h"
+#include "features/volume.h"
 #include "ui/toast.h"
+#include "util/app.h"
 #include "util/client.h"
 #include "util/config.h"
+#include "util/icon_cache.h"
+#include "util/icon_theme.h"
+#include "util/layout.h"
+#include "util/loop.h"
+#include "util/monitor.h"
+#include "util/pointer.h"
+#include "util/shm_image.h"
+#include "util/spawn.h"
+#include "util/stats.h"
+#include "util/wallpaper.h"
+#include "util/workspace.h"
 
 struct Config config = {0};
 
@@ -61,16 +75,121 @@ static int file_exists(const char *path) {
     return (stat(path, &buffer) == 0);
 }
 
-static void setup_mirroring() {
-    mocha_log("Attempting to mirror displays using xrandr...");
-    const char *cmd = "xrandr --output eDP-1 --same-as DP-1";
-    int result = system(cmd);
-    if(result == 0) {
-        mocha_log("xrandr mirroring command executed successfully.");
-    } else {
-        mocha_log(
-            "xrandr mirroring command failed or xrandr is not installed.");
+/**
+ * Collapse queued MotionNotify events for the window being dragged or resized
+ * down to the newest one, so each batch does at most one move/resize
+ */
+static void coalesce_motion(XEvent *event, struct DragState *drag_state) {
+    if(event->type != MotionNotify) return;
+    mocha_stats.motion_events++;
+    if(drag_state->active_window == None ||
+       !(drag_state->dragging || drag_state->resizing))
+        return;
+
+    XEvent next;
+    while(XEventsQueued(dpy, QueuedAfterReading) > 0) {
+        XPeekEvent(dpy, &next);
+        if(next.type != MotionNotify ||
+           next.xmotion.window != event->xmotion.window)
+            break;
+        XNextEvent(dpy, event);
+        mocha_stats.motion_events++;
+        mocha_stats.motion_coalesced++;
+    }
+}
+
+struct MainContext {
+    Window taskbar;
+    int taskbar_height;
+    struct DragState drag_state;
+};
+
+/**
+ * Keep the taskbar along the bottom of the primary monitor
+ */
+static void place_taskbar(struct MainContext *ctx) {
+    const Monitor *mon = &monitors[0];
+    XMoveResizeWindow(dpy, ctx->taskbar, mon->x,
+                      mon->y + mon->h - ctx->taskbar_height, mon->w,
+                      ctx->taskbar_height);
+    mocha_draw_dock(ctx->taskbar);
+}
+
+/**
+ * Handle everything queued on the X connection as one batch
+ */
+static void dispatch_x_events(void *data) {
+    struct MainContext *ctx = data;
+    XEvent event;
+
+    while(XEventsQueued(dpy, QueuedAfterReading) > 0) {
+        XNextEvent(dpy, &event);
+        coalesce_motion(&event, &ctx->drag_state);
+        mocha_stats_begin_event(event.type);
+        if(mocha_monitor_handle_event(&event)) {
+            place_taskbar(ctx);
+            continue;
+        }
+        if(mocha_shm_image_handle_event(&event)) continue;
+        mocha_handle_event(event, ctx->taskbar, &ctx->drag_state,
+                           ctx->taskbar_height,
+                           config.features.tiling_enabled);
+    }
+    mocha_flush_retile(ctx->taskbar_height, config.features.tiling_enabled);
+    mocha_commit();
+}
+
+static void handle_signal_fd(int fd, void *data) {
+    struct signalfd_siginfo info;
+    while(read(fd, &info, sizeof(info)) == sizeof(info)) {
+        switch(info.ssi_signo) {
+            case SIGCHLD:
+                mocha_spawn_reap();
+                break;
+            case SIGUSR1:
+                mocha_stats_log();
+                break;
+            case SIGINT:
+            case SIGTERM:
+            case SIGHUP:
+                mocha_log("Received signal %d, exiting...", info.ssi_signo);
+                mocha_loop_quit();
+                break;
+        }
+    }
+}
+
+/* Signals handled through the signalfd */
+static sigset_t signal_mask;
+static bool signals_blocked = false;
+
+/**
+ * Block the signals the main loop handles. Must run before any thread is
+ * started, threads inherit the mask and would otherwise take them
+ */
+static void block_signals() {
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGTERM);
+    sigaddset(&signal_mask, SIGHUP);
+    sigaddset(&signal_mask, SIGUSR1);
+    sigaddset(&signal_mask, SIGCHLD);
+    if(sigprocmask(SIG_BLOCK, &signal_mask, NULL) < 0) {
+        perror("sigprocmask");
+        return;
     }
+    signals_blocked = true;
+}
+
+/**
+ * Route the blocked signals through a signalfd so they are handled in the
+ * main loop
+ */
+static int setup_signal_fd() {
+    if(!signals_blocked) return -1;
+    int fd = signalfd(-1, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(fd < 0) perror("signalfd");
+    return fd;
 }
 
 void sigsegv_handler(int sig) {
@@ -85,6 +204,7 @@ void sigsegv_handler(int sig) {
 
 int main(void) {
     signal(SIGSEGV, sigsegv_handler);
+    block_signals();
     mocha_log("Mocha v1.0 starting...");
 
     mocha_log("Loading config...");
@@ -184,9 +304,16 @@ int main(void) {
     XAllocColor(dpy, colormap, &accent_xcolor);
     accent_color = accent_xcolor.pixel;
 
+    mocha_monitor_init(mocha_layout_by_name(config.features.layout));
+    mocha_workspace_init(config.features.workspaces);
+    mocha_icon_theme_init(config.features.icon_theme);
+    if(config.features.icon_cache_kb > 0)
+        mocha_icon_cache_set_budget((size_t)config.features.icon_cache_kb *
+                                    1024);
+
     mocha_log("Setting up taskbar...");
     if(config.features.quotes_enabled) show_quote_window(get_random_quote());
-    if(config.exec_one[0]) system(config.exec_one);
+    if(config.exec_one[0]) mocha_spawn(config.exec_one);
 
     int taskbar_height = 60;
     int screen_height = DisplayHeight(dpy, screen);
@@ -194,31 +321,12 @@ int main(void) {
     int root_depth = DefaultDepth(dpy, screen);
     mocha_log("Root window depth: %d", root_depth);
 
-    Pixmap wallpaper_pixmap = None;
+    /* A cold cache leaves a plain background until the decode is done */
+    int wallpaper_fd = -1;
     if(config.colors.wallpaper[0]) {
-        mocha_log("Creating wallpaper pixmap: %dx%d", screen_width,
-                  screen_height);
-        wallpaper_pixmap =
-            XCreatePixmap(dpy, root, screen_width, screen_height, root_depth);
-        if(wallpaper_pixmap == None) {
-            mocha_log("Failed to create wallpaper pixmap!");
-        } else {
-            mocha_log("Drawing wallpaper to pixmap...");
-            cairo_surface_t *pixmap_surface = cairo_xlib_surface_create(
-                dpy, wallpaper_pixmap, DefaultVisual(dpy, screen), screen_width,
-                screen_height);
-            if(cairo_surface_status(pixmap_surface) != CAIRO_STATUS_SUCCESS) {
-                mocha_log("Failed to create Cairo surface for pixmap!");
-            } else {
-                mocha_draw_wallpaper(pixmap_surface, config.colors.wallpaper,
-                                     screen_width, screen_height);
-                mocha_log("Setting wallpaper pixmap as root background...");
-                XSetWindowBackgroundPixmap(dpy, root, wallpaper_pixmap);
-                mocha_log("Clearing root window to show wallpaper...");
-                XClearWindow(dpy, root);
-            }
-            cairo_surface_destroy(pixmap_surface);
-        }
+        wallpaper_fd = mocha_wallpaper_init(config.colors.wallpaper,
+                                            config.colors.wallpaper_mode,
+                                            screen_width, screen_height);
     } else {
         XSetWindowBackground(dpy, root, 0x000000);
         XClearWindow(dpy, root);
@@ -230,15 +338,16 @@ int main(void) {
         has_render = True;
     }
 
+    const Monitor *primary = &monitors[0];
     Window taskbar;
     if(has_render) {
-        taskbar =
-            XCreateSimpleWindow(dpy, root, 0, screen_height - taskbar_height,
-                                screen_width, taskbar_height, 0, 0, 0x000000);
+        taskbar = XCreateSimpleWindow(
+            dpy, root, primary->x, primary->y + primary->h - taskbar_height,
+            primary->w, taskbar_height, 0, 0, 0x000000);
     } else {
-        taskbar =
-            XCreateSimpleWindow(dpy, root, 0, screen_height - taskbar_height,
-                                screen_width, taskbar_height, 0, 0, 0x000000);
+        taskbar = XCreateSimpleWindow(
+            dpy, root, primary->x, primary->y + primary->h - taskbar_height,
+            primary->w, taskbar_height, 0, 0, 0x000000);
     }
     XSelectInput(dpy, taskbar,
                  ExposureMask | ButtonPressMask | ButtonReleaseMask);
@@ -249,7 +358,7 @@ int main(void) {
                     PropModeReplace, (unsigned char *)&dock_type, 1);
     mocha_init_dock();
 
-    mocha_tile_clients(taskbar_height);
+    mocha_request_retile();
 
     Cursor cursor = XCreateFontCursor(dpy, XC_left_ptr);
     XDefineCursor(dpy, root, cursor);
@@ -258,6 +367,7 @@ int main(void) {
                  SubstructureRedirectMask | SubstructureNotifyMask |
                      ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
                      EnterWindowMask | LeaveWindowMask);
+    mocha_stack_init();
 
     mocha_log("Setting up keybinds...");
     XGrabKey(dpy, XKeysymToKeycode(dpy, XK_z), Mod1Mask, root, True,
@@ -272,6 +382,12 @@ int main(void) {
              GrabModeAsync, GrabModeAsync);
     XGrabKey(dpy, XKeysymToKeycode(dpy, XK_c), Mod1Mask, root, True,
              GrabModeAsync, GrabModeAsync);
+    for(int i = 0; i < num_workspaces; i++) {
+        XGrabKey(dpy, XKeysymToKeycode(dpy, XK_1 + i), Mod1Mask, root, True,
+                 GrabModeAsync, GrabModeAsync);
+        XGrabKey(dpy, XKeysymToKeycode(dpy, XK_1 + i), Mod1Mask | ShiftMask,
+                 root, True, GrabModeAsync, GrabModeAsync);
+    }
     XGrabKey(dpy, XKeysymToKeycode(dpy, XF86XK_AudioRaiseVolume), 0, root, True,
              GrabModeAsync, GrabModeAsync);
     XGrabKey(dpy, XKeysymToKeycode(dpy, XF86XK_AudioLowerVolume), 0, root, True,
@@ -294,19 +410,32 @@ int main(void) {
     }
 
     mocha_log("Mocha v1.0 started!");
-    struct DragState drag_state = {0};
-
-    XEvent event;
-    for(;;) {
-        cleanup_toasts();
-        animate_toasts();
-        XNextEvent(dpy, &event);
-
-        mocha_handle_event(event, taskbar, &drag_state, taskbar_height,
-                           config.features.tiling_enabled);
-    }
-
+    mocha_stats_init();
+    mocha_stats.debug_roundtrips = config.features.debug_roundtrips;
+
+    struct MainContext ctx = {0};
+    ctx.taskbar = taskbar;
+    ctx.taskbar_height = taskbar_height;
+
+    int signal_fd = setup_signal_fd();
+    if(signal_fd >= 0) mocha_loop_add_fd(signal_fd, handle_signal_fd, NULL);
+    int toast_fd = toast_timer_init();
+    if(toast_fd >= 0) mocha_loop_add_fd(toast_fd, toast_handle_timer, NULL);
+    int apps_fd = mocha_apps_watch_init();
+    if(apps_fd >= 0) mocha_loop_add_fd(apps_fd, mocha_apps_handle_watch, NULL);
+    int apps_load_fd = mocha_apps_load_async();
+    if(apps_load_fd >= 0)
+        mocha_loop_add_fd(apps_load_fd, mocha_apps_handle_loaded, NULL);
+    int volume_fd = mocha_volume_init(
+        mocha_volume_backend_by_name(config.features.volume_backend));
+    if(volume_fd >= 0)
+        mocha_loop_add_fd(volume_fd, mocha_volume_handle_result, NULL);
+    if(wallpaper_fd >= 0)
+        mocha_loop_add_fd(wallpaper_fd, mocha_wallpaper_handle_loaded, NULL);
+
+    mocha_loop_run(dispatch_x_events, &ctx);
+
+    mocha_wallpaper_free();
     XCloseDisplay(dpy);
-    if(wallpaper_pixmap != None) XFreePixmap(dpy, wallpaper_pixmap);
     return 0;
 }
@@ -6,29 +6,125 @@
 #include <X11/keysym.h>
 #include <cairo/cairo-xlib.h>
 #include <cairo/cairo.h>
+#include <errno.h>
 #include <math.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 #include "main.h"
 #include "util/app.h"
 #include "util/config.h"
+#include "util/icon_cache.h"
+#include "util/monitor.h"
+#include "util/shm_image.h"
+#include "util/spawn.h"
+#include "util/stats.h"
+
+#define LAUNCHER_ICON_SIZE 64
+
+/* Where each app was last drawn, so its icon can be filled in once the
+   decoder pool delivers it */
+typedef struct {
+    int x, y;
+    bool waiting;
+} LauncherTile;
+
+static LauncherTile tiles[MAX_APPS];
+static int num_waiting = 0;
+
+/* Back-buffer in shared memory when the server has MIT-SHM, otherwise
+   cairo draws straight into the window */
+static ShmImage back;
+static GC back_gc = None;
+
+/* Show a drawn region of the launcher */
+static void present_launcher(Window win, cairo_surface_t *surface, int x,
+                             int y, int w, int h) {
+    if(back.surface)
+        mocha_shm_image_put(&back, win, back_gc, x, y, w, h);
+    else
+        cairo_surface_flush(surface);
+}
+
+static void draw_launcher_icon(cairo_t *cr, cairo_surface_t *icon, int x,
+                               int y, int size) {
+    cairo_save(cr);
+    if(icon) {
+        cairo_set_source_surface(cr, icon, x, y);
+        cairo_paint(cr);
+    } else {
+        cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
+        cairo_rectangle(cr, x, y, size, size);
+        cairo_fill(cr);
+    }
+    cairo_restore(cr);
+}
+
+/**
+ * Repaint the tiles whose icons have been decoded since they were drawn
+ */
+static void fill_launcher_icons(cairo_t *cr, Window win,
+                                cairo_surface_t *surface) {
+    if(back.surface) mocha_shm_image_wait(&back);
+    for(int i = 0; i < app_count && num_waiting > 0; i++) {
+        if(!tiles[i].waiting) continue;
+        bool pending;
+        cairo_surface_t *icon = mocha_icon_cache_request(
+            apps[i].icon_path, LAUNCHER_ICON_SIZE, &pending);
+        if(pending) continue;
+        tiles[i].waiting = false;
+        num_waiting--;
+
+        /* Placeholder off, background and icon on */
+        cairo_save(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_rgba(cr, 0.1, 0.1, 0.1, 0.9);
+        cairo_rectangle(cr, tiles[i].x, tiles[i].y, LAUNCHER_ICON_SIZE,
+                        LAUNCHER_ICON_SIZE);
+        cairo_fill(cr);
+        cairo_restore(cr);
+        draw_launcher_icon(cr, icon, tiles[i].x, tiles[i].y,
+                           LAUNCHER_ICON_SIZE);
+        present_launcher(win, surface, tiles[i].x, tiles[i].y,
+                         LAUNCHER_ICON_SIZE, LAUNCHER_ICON_SIZE);
+    }
+}
+
+/**
+ * Block until an X event is queued or decoded icons are ready, returns
+ * true for the latter
+ */
+static bool wait_launcher_event(Display *dpy, int icon_fd) {
+    if(icon_fd < 0 || num_waiting == 0 || XPending(dpy)) return false;
+    struct pollfd fds[2] = {
+        {ConnectionNumber(dpy), POLLIN, 0},
+        {icon_fd, POLLIN, 0},
+    };
+    while(poll(fds, 2, -1) < 0)
+        if(errno != EINTR) return false;
+    return (fds[1].revents & POLLIN) && !(fds[0].revents & POLLIN);
+}
 
 void show_launcher(Display *dpy, int screen) {
+    double opened = mocha_stats_now_ms();
     find_applications();
+    int icon_fd = mocha_icon_cache_async_fd();
+    bool first_frame = true, filled = false;
 
     Window root = RootWindow(dpy, screen);
     int width = 500;
     int height = 400;
     int taskbar_height = 60;
     int padding = 10;
-    int x = padding;
-    int y = DisplayHeight(dpy, screen) - height - taskbar_height - padding;
+    /* Just above the taskbar on the primary monitor */
+    const Monitor *mon = &monitors[0];
+    int x = mon->x + padding;
+    int y = mon->y + mon->h - height - taskbar_height - padding;
 
     XSetWindowAttributes attrs;
     attrs.override_redirect = True;
@@ -46,17 +142,40 @@ void show_launcher(Display *dpy, int screen) {
     XMapWindow(dpy, win);
     XSetInputFocus(dpy, win, RevertToParent, CurrentTime);
 
-    cairo_surface_t *surface =
-        cairo_xlib_surface_create(dpy, win, argb_visual, width, height);
+    cairo_surface_t *surface;
+    if(mocha_shm_available() &&
+       mocha_shm_image_create(&back, argb_visual, argb_depth, width, height) &&
+       back.shared) {
+        surface = cairo_surface_reference(back.surface);
+        back_gc = XCreateGC(dpy, win, 0, NULL);
+    } else {
+        if(back.surface) mocha_shm_image_destroy(&back);
+        surface =
+            cairo_xlib_surface_create(dpy, win, argb_visual, width, height);
+    }
     cairo_t *cr = cairo_create(surface);
 
     int scroll_y = 0;
     bool running = true;
     while(running) {
+        if(wait_launcher_event(dpy, icon_fd)) {
+            if(mocha_icon_cache_collect() > 0) {
+                fill_launcher_icons(cr, win, surface);
+                XFlush(dpy);
+            }
+            if(!filled && num_waiting == 0) {
+                mocha_stats_launcher_filled(mocha_stats_now_ms() - opened);
+                filled = true;
+            }
+            continue;
+        }
+
         XEvent e;
         XNextEvent(dpy, &e);
+        if(mocha_shm_image_handle_event(&e)) continue;
 
         if(e.type == Expose) {
+            if(back.surface) mocha_shm_image_wait(&back);
             cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
             cairo_set_source_rgba(cr, 0, 0, 0, 0);
             cairo_paint(cr);
@@ -67,36 +186,37 @@ void show_launcher(Display *dpy, int screen) {
             cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
 
             int columns = 5;
-            int icon_size = 64;
+            int icon_size = LAUNCHER_ICON_SIZE;
             int h_padding = 20;
             int v_padding = 20;
             int text_height = 30;
             int item_width = (width - (columns + 1) * h_padding) / columns;
             int item_height = icon_size + text_height;
+            /* Holes and off-screen apps must not keep stale tiles */
+            memset(tiles, 0, sizeof(tiles));
+            num_waiting = 0;
 
-            for(int i = 0; i < app_count; i++) {
-                int col = i % columns;
-                int row = i / columns;
+            /* Removed apps leave holes in apps[], cell counts shown ones */
+            for(int i = 0, cell = 0; i < app_count; i++) {
+                if(!apps[i].name[0]) continue;
+                int col = cell % columns;
+                int row = cell / columns;
+                cell++;
                 int app_x = h_padding + col * (item_width + h_padding);
                 int app_y =
                     v_padding + row * (item_height + v_padding) - scroll_y;
 
                 if(app_y + item_height < 0 || app_y > height) continue;
 
-                load_app_icon(&apps[i], icon_size);
-
-                cairo_save(cr);
-
-                if(apps[i].icon_surface) {
-                    cairo_set_source_surface(cr, apps[i].icon_surface, app_x,
-                                             app_y);
-                    cairo_paint(cr);
-                } else {
-                    cairo_set_source_rgb(cr, 0.3, 0.3, 0.3);
-                    cairo_rectangle(cr, app_x, app_y, icon_size, icon_size);
-                    cairo_fill(cr);
+                /* Icons still decoding get a placeholder for now */
+                bool pending;
+                cairo_surface_t *icon = mocha_icon_cache_request(
+                    apps[i].icon_path, icon_size, &pending);
+                if(pending) {
+                    tiles[i] = (LauncherTile){app_x, app_y, true};
+                    num_waiting++;
                 }
-                cairo_restore(cr);
+                draw_launcher_icon(cr, icon, app_x, app_y, icon_size);
 
                 char truncated_name[256];
                 strncpy(truncated_name, apps[i].name,
@@ -130,7 +250,18 @@ void show_launcher(Display *dpy, int screen) {
                 cairo_move_to(cr, text_x, app_y + icon_size + 15);
                 cairo_show_text(cr, truncated_name);
             }
-            cairo_surface_flush(surface);
+            present_launcher(win, surface, 0, 0, width, height);
+
+            double now = mocha_stats_now_ms();
+            if(first_frame) {
+                XFlush(dpy);
+                mocha_stats_launcher_frame(now - opened);
+                first_frame = false;
+            }
+            if(!filled && num_waiting == 0) {
+                mocha_stats_launcher_filled(now - opened);
+                filled = true;
+            }
 
         } else if(e.type == KeyPress) {
             if(XLookupKeysym(&e.xkey, 0) == XK_Escape) {
@@ -143,11 +274,14 @@ void show_launcher(Display *dpy, int screen) {
         }
 
         int columns = 5;
-        int icon_size = 64;
+        int icon_size = LAUNCHER_ICON_SIZE;
         int v_padding = 20;
         int text_height = 30;
         int item_height = icon_size + text_height;
-        int total_rows = (app_count + columns - 1) / columns;
+        int shown = 0;
+        for(int i = 0; i < app_count; i++)
+            if(apps[i].name[0]) shown++;
+        int total_rows = (shown + columns - 1) / columns;
         int max_scroll =
             total_rows * (item_height + v_padding) - height + v_padding;
         if(scroll_y < 0) scroll_y = 0;
@@ -158,25 +292,18 @@ void show_launcher(Display *dpy, int screen) {
             int h_padding = 20;
             int item_width = (width - (columns + 1) * h_padding) / columns;
 
-            for(int i = 0; i < app_count; i++) {
-                int col = i % columns;
-                int row = i / columns;
+            for(int i = 0, cell = 0; i < app_count; i++) {
+                if(!apps[i].name[0]) continue;
+                int col = cell % columns;
+                int row = cell / columns;
+                cell++;
                 int app_x = h_padding + col * (item_width + h_padding);
                 int app_y =
                     v_padding + row * (item_height + v_padding) - scroll_y;
 
                 if(e.xbutton.x >= app_x && e.xbutton.x <= app_x + icon_size &&
                    e.xbutton.y >= app_y && e.xbutton.y <= app_y + icon_size) {
-                    pid_t pid = fork();
-                    if(pid == 0) {
-                        setsid();
-                        execl("/bin/sh", "sh", "-c", apps[i].exec,
-                              (char *)NULL);
-                        perror("execl");
-                        exit(1);
-                    } else if(pid > 0) {
-                        running = false;
-                    }
+                    if(mocha_spawn(apps[i].exec) > 0) running = false;
                     break;
                 }
             }
@@ -184,5 +311,15 @@ void show_launcher(Display *dpy, int screen) {
     }
     cairo_surface_destroy(surface);
     cairo_destroy(cr);
+    if(back.surface) {
+        mocha_shm_image_destroy(&back);
+        XFreeGC(dpy, back_gc);
+        back_gc = None;
+    }
     XDestroyWindow(dpy, win);
+
+    /* Only the dock's icons stay cached while the launcher is closed */
+    mocha_icon_cache_collect();
+    mocha_icon_cache_drop_size(LAUNCHER_ICON_SIZE);
+    num_waiting = 0;
 }
\ No newline at end of file
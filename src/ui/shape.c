@@ -0,0 +1,124 @@
+#include "ui/shape.h"
+
+#include <X11/extensions/shape.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "util/client.h"
+
+/*
+ * Rounded window shapes as lists of scanline rectangles, so the server
+ * gets one XShapeCombineRectangles instead of a pixmap, a GC and four
+ * arcs. Rectangle lists are kept in a small LRU keyed by size and radius.
+ */
+
+#define SHAPE_CACHE_SIZE 8
+
+typedef struct {
+    int w, h, radius;
+    int count;
+    XRectangle *rects;
+} ShapeEntry;
+
+/* Most recently used first */
+static ShapeEntry shape_cache[SHAPE_CACHE_SIZE];
+static int shape_cache_len = 0;
+
+/* Per-row corner insets for the last radius used */
+static int *insets = NULL;
+static int insets_radius = -1;
+
+static const int *corner_insets(int radius) {
+    if(radius == insets_radius) return insets;
+    int *grown = realloc(insets, radius * sizeof(*grown));
+    if(!grown) return NULL;
+    insets = grown;
+    insets_radius = radius;
+    for(int y = 0; y < radius; y++) {
+        double dy = radius - (y + 0.5);
+        double dx = sqrt((double)radius * radius - dy * dy);
+        insets[y] = (int)(radius - dx + 0.5);
+    }
+    return insets;
+}
+
+/* Build the banded rectangle list for a w x h box with rounded corners */
+static XRectangle *build_rects(int w, int h, int radius, int *count) {
+    const int *inset = corner_insets(radius);
+    if(!inset) return NULL;
+    XRectangle *rects = malloc((2 * radius + 1) * sizeof(*rects));
+    if(!rects) return NULL;
+
+    int n = 0;
+    for(int y = 0; y < radius;) {
+        int rows = 1;
+        while(y + rows < radius && inset[y + rows] == inset[y]) rows++;
+        rects[n++] = (XRectangle){inset[y], y, w - 2 * inset[y], rows};
+        y += rows;
+    }
+    if(h > 2 * radius) rects[n++] = (XRectangle){0, radius, w, h - 2 * radius};
+    for(int i = n - (h > 2 * radius ? 2 : 1); i >= 0; i--) {
+        XRectangle top = rects[i];
+        rects[n++] = (XRectangle){top.x, h - top.y - top.height, top.width,
+                                  top.height};
+    }
+    *count = n;
+    return rects;
+}
+
+static ShapeEntry *lookup_shape(int w, int h, int radius) {
+    for(int i = 0; i < shape_cache_len; i++) {
+        if(shape_cache[i].w == w && shape_cache[i].h == h &&
+           shape_cache[i].radius == radius) {
+            ShapeEntry hit = shape_cache[i];
+            memmove(&shape_cache[1], &shape_cache[0], i * sizeof(hit));
+            shape_cache[0] = hit;
+            return &shape_cache[0];
+        }
+    }
+
+    int count;
+    XRectangle *rects = build_rects(w, h, radius, &count);
+    if(!rects) return NULL;
+    if(shape_cache_len == SHAPE_CACHE_SIZE)
+        free(shape_cache[--shape_cache_len].rects);
+    memmove(&shape_cache[1], &shape_cache[0],
+            shape_cache_len * sizeof(shape_cache[0]));
+    shape_cache_len++;
+    shape_cache[0] = (ShapeEntry){w, h, radius, count, rects};
+    return &shape_cache[0];
+}
+
+/**
+ * Give a window rounded corners, skipped when a managed client already
+ * has this exact shape
+ */
+void mocha_shape_round_corners(Window win, int width, int height, int radius) {
+    if(width <= 0 || height <= 0) return;
+    if(radius > width / 2) radius = width / 2;
+    if(radius > height / 2) radius = height / 2;
+    if(radius < 0) radius = 0;
+
+    Client *c = mocha_client_find(win);
+    if(c && c->has_shape && c->shape_radius == radius &&
+       (radius == 0 || (c->shape_w == width && c->shape_h == height)))
+        return;
+
+    if(radius == 0) {
+        XShapeCombineMask(dpy, win, ShapeBounding, 0, 0, None, ShapeSet);
+    } else {
+        ShapeEntry *shape = lookup_shape(width, height, radius);
+        if(!shape) return;
+        XShapeCombineRectangles(dpy, win, ShapeBounding, 0, 0, shape->rects,
+                                shape->count, ShapeSet, YXBanded);
+    }
+
+    if(c) {
+        c->has_shape = 1;
+        c->shape_w = width;
+        c->shape_h = height;
+        c->shape_radius = radius;
+    }
+}
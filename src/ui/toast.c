@@ -8,9 +8,13 @@
 #include <cairo/cairo-xlib.h>
 #include <cairo/cairo.h>
 #include <math.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "util/config.h"
+#include "util/monitor.h"
 
 #define MAX_QUOTES 64
 #define MAX_QUOTE_LEN 256
@@ -23,6 +27,26 @@ static int quote_width = 1440;
 
 Toast *toasts = NULL;
 
+static int toast_timer_fd = -1;
+static int toasts_animating = 0;
+
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Give every toast its slot, newest on top
+ */
+static void layout_toasts() {
+    int toast_y = monitors[0].y + TOAST_PADDING;
+    for(Toast *t = toasts; t; t = t->next) {
+        t->target_y = toast_y;
+        toast_y += TOAST_HEIGHT + TOAST_PADDING;
+    }
+}
+
 void load_quotes(const char *filename) {
     num_quotes = 0;
     FILE *f = fopen(filename, "r");
@@ -49,8 +73,9 @@ void show_quote_window(const char *quote) {
     if(quote_win) destroy_quote_window();
     int w = quote_width;
     int h = 48;
-    int x = (DisplayWidth(dpy, screen) - w) / 2;
-    int y = DisplayHeight(dpy, screen) - h - 40;
+    const Monitor *mon = &monitors[0];
+    int x = mon->x + (mon->w - w) / 2;
+    int y = mon->y + mon->h - h - 40;
 
     Pixmap bg_pixmap =
         XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
@@ -153,14 +178,9 @@ void show_toast(const char *message) {
     int toast_w = TOAST_WIDTH;
     int toast_h = TOAST_HEIGHT;
     int toast_pad = TOAST_PADDING;
-    int toast_x = DisplayWidth(dpy, screen) - toast_w - toast_pad;
-    int toast_y = toast_pad;
-
-    Toast *existing_toast = toasts;
-    while(existing_toast) {
-        toast_y += toast_h + toast_pad;
-        existing_toast = existing_toast->next;
-    }
+    const Monitor *mon = &monitors[0];
+    int toast_x = mon->x + mon->w - toast_w - toast_pad;
+    int toast_y = mon->y + toast_pad;
 
     XSetWindowAttributes attrs;
     attrs.override_redirect = True;
@@ -184,21 +204,26 @@ void show_toast(const char *message) {
     new_toast->win = toast_win;
     strncpy(new_toast->message, message, sizeof(new_toast->message) - 1);
     new_toast->message[sizeof(new_toast->message) - 1] = '\0';
-    new_toast->created_at = time(NULL);
+    new_toast->expires_at = monotonic_ms() + TOAST_TIMEOUT * 1000;
     new_toast->current_x = start_x;
     new_toast->target_x = toast_x;
+    new_toast->current_y = toast_y;
+    new_toast->target_y = toast_y;
     new_toast->velocity = 0;
     new_toast->alpha = 255;
     new_toast->next = toasts;
     toasts = new_toast;
+    layout_toasts();
+    schedule_toasts();
 }
 
 Toast *status_toast_ptr = NULL;
 
 void status_toast(const char *message) {
     int size = 200;
-    int x = (DisplayWidth(dpy, screen) - size) / 2;
-    int y = (DisplayHeight(dpy, screen) - size) / 2;
+    const Monitor *mon = &monitors[0];
+    int x = mon->x + (mon->w - size) / 2;
+    int y = mon->y + (mon->h - size) / 2;
 
     if(status_toast_ptr) {
         XDestroyWindow(dpy, status_toast_ptr->win);
@@ -227,50 +252,120 @@ void status_toast(const char *message) {
     new_toast->win = toast_win;
     strncpy(new_toast->message, message, sizeof(new_toast->message) - 1);
     new_toast->message[sizeof(new_toast->message) - 1] = '\0';
-    new_toast->created_at = time(NULL);
+    new_toast->expires_at = monotonic_ms() + TOAST_TIMEOUT * 1000;
     new_toast->current_x = x;
     new_toast->target_x = x;
+    new_toast->current_y = y;
+    new_toast->target_y = y;
     new_toast->velocity = 0;
     new_toast->alpha = 255;
     new_toast->next = NULL;
     status_toast_ptr = new_toast;
+    schedule_toasts();
 }
 
-void animate_toasts() {
-    Toast *t = toasts;
-    int toast_pad = TOAST_PADDING;
-    int toast_h = TOAST_HEIGHT;
-    int toast_y = toast_pad;
-    while(t) {
-        XMoveWindow(dpy, t->win, t->current_x, toast_y);
-        toast_y += toast_h + toast_pad;
-        t = t->next;
-    }
-    if(status_toast_ptr) {
-        int size = 200;
-        int x = (DisplayWidth(dpy, screen) - size) / 2;
-        int y = (DisplayHeight(dpy, screen) - size) / 2;
-        XMoveWindow(dpy, status_toast_ptr->win, x, y);
+static int toast_step(int distance) {
+    int step = distance / 3;
+    if(step == 0) step = distance > 0 ? 1 : -1;
+    return step;
+}
+
+/**
+ * Move toasts one frame towards their slots, only touching the ones that
+ * are not there yet. Returns whether any toast is still moving
+ */
+int animate_toasts() {
+    toasts_animating = 0;
+    for(Toast *t = toasts; t; t = t->next) {
+        int dx = t->target_x - t->current_x;
+        int dy = t->target_y - t->current_y;
+        if(dx == 0 && dy == 0) continue;
+        if(dx) t->current_x += toast_step(dx);
+        if(dy) t->current_y += toast_step(dy);
+        XMoveWindow(dpy, t->win, t->current_x, t->current_y);
+        if(t->current_x != t->target_x || t->current_y != t->target_y)
+            toasts_animating = 1;
     }
+    return toasts_animating;
 }
 
-void cleanup_toasts() {
-    time_t now = time(NULL);
+/**
+ * Destroy expired toasts, returns the number removed
+ */
+int cleanup_toasts() {
+    long long now = monotonic_ms();
+    int removed = 0;
     Toast **t = &toasts;
     while(*t) {
-        if(difftime(now, (*t)->created_at) > TOAST_TIMEOUT) {
+        if(now >= (*t)->expires_at) {
             Toast *to_remove = *t;
             *t = to_remove->next;
             XDestroyWindow(dpy, to_remove->win);
             free(to_remove);
+            removed++;
         } else {
             t = &(*t)->next;
         }
     }
-    if(status_toast_ptr &&
-       difftime(now, status_toast_ptr->created_at) > TOAST_TIMEOUT) {
+    if(status_toast_ptr && now >= status_toast_ptr->expires_at) {
         XDestroyWindow(dpy, status_toast_ptr->win);
         free(status_toast_ptr);
         status_toast_ptr = NULL;
+        removed++;
+    }
+    if(removed) layout_toasts();
+    return removed;
+}
+
+/**
+ * Arm the toast timer for the next expiry or animation frame
+ */
+void schedule_toasts() {
+    if(toast_timer_fd < 0) return;
+
+    long long next = 0;
+    for(Toast *t = toasts; t; t = t->next) {
+        if(!next || t->expires_at < next) next = t->expires_at;
+        if(t->current_x != t->target_x || t->current_y != t->target_y)
+            toasts_animating = 1;
+    }
+    if(status_toast_ptr && (!next || status_toast_ptr->expires_at < next))
+        next = status_toast_ptr->expires_at;
+    if(toasts_animating) {
+        long long frame = monotonic_ms() + TOAST_FRAME_MS;
+        if(!next || frame < next) next = frame;
+    }
+
+    /* A zero it_value disarms the timer */
+    struct itimerspec spec = {0};
+    if(next) {
+        spec.it_value.tv_sec = next / 1000;
+        spec.it_value.tv_nsec = (next % 1000) * 1000000;
+    }
+    timerfd_settime(toast_timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * Create the timer that drives toast expiry and animation
+ */
+int toast_timer_init() {
+    toast_timer_fd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(toast_timer_fd < 0) {
+        perror("timerfd_create");
+        return -1;
     }
+    schedule_toasts();
+    return toast_timer_fd;
+}
+
+/**
+ * Main loop callback for the toast timer
+ */
+void toast_handle_timer(int fd, void *data) {
+    uint64_t expirations;
+    if(read(fd, &expirations, sizeof(expirations)) < 0) return;
+    cleanup_toasts();
+    animate_toasts();
+    schedule_toasts();
 }
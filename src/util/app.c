@@ -1,185 +1,782 @@
 #include "util/app.h"
 
 #include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#include "lib/stb_image.h"
 #include "main.h"
+#include "util/app_index.h"
+#include "util/client.h"
 #include "util/config.h"
+#include "util/desktop_entry.h"
+#include "util/icon_cache.h"
+#include "util/icon_theme.h"
+#include "util/intern.h"
+#include "util/loop.h"
 
 AppInfo apps[MAX_APPS];
 int app_count = 0;
 bool apps_loaded = false;
 
-static void cleanup_exec_command(char *exec) {
-    for(char *p = exec; *p; p++) {
-        if(*p == '%') {
-            *p = ' ';
-            if(*(p + 1) != '\0') {
-                *(p + 1) = ' ';
-            }
+static const char *app_dirs[APP_INDEX_DIRS] = {
+    "/usr/share/applications", "/usr/local/share/applications",
+    "~/.local/share/applications"};
+static char app_dir_paths[APP_INDEX_DIRS][1024];
+
+/* Table apps[] points into, mapped from the index or built by a scan.
+   Apps patched by the watcher point at interned strings instead */
+static AppTable app_table;
+/* Where each app came from, interned file name and app_dirs index */
+static const char *app_file[MAX_APPS];
+static uint32_t app_dir[MAX_APPS];
+
+/* Growable string table, offset 0 is the empty string */
+typedef struct {
+    char *data;
+    uint32_t size, cap;
+} StringTable;
+
+/* Tables built by directory scans. There are two, so a background
+   rescan fills one while apps[] still points into the other */
+typedef struct {
+    StringTable strings;
+    AppRecord records[MAX_APPS];
+} ScanResult;
+
+static ScanResult scan_results[2];
+
+/*
+ * Directory scans are sharded over a small worker pool. The walk lists
+ * every .desktop file first, workers claim files one at a time and parse
+ * into their own string table, and the results are merged in walk order,
+ * so the app list does not depend on scheduling.
+ */
+#define SCAN_MAX_WORKERS 4
+/* Fewer files than this per worker are not worth a thread */
+#define SCAN_FILES_PER_WORKER 32
+
+/* One .desktop file found by the walk */
+typedef struct {
+    uint32_t dir;
+    /* File name, offset in scan_files */
+    uint32_t file;
+    /* Worker whose strings the record points into, -1 if not listed */
+    int worker;
+    AppRecord record;
+} ScanJob;
+
+typedef struct {
+    pthread_t thread;
+    StringTable strings;
+} ScanWorker;
+
+static StringTable scan_files;
+static ScanJob *scan_jobs;
+static uint32_t scan_job_count, scan_job_cap;
+static atomic_uint scan_next;
+static ScanWorker scan_workers[SCAN_MAX_WORKERS];
+
+/* Background load, at startup or after the watcher lost track, finished
+   on the main thread. apps[] keeps the current table until then */
+static pthread_t load_thread;
+static bool load_pending = false;
+/* Skip the index and scan the directories */
+static bool load_scan = false;
+/* An app directory changed while the loader was running */
+static bool load_stale = false;
+static int64_t load_mtimes[APP_INDEX_DIRS];
+static AppTable load_result;
+/* Eventfd of the running loader */
+static int load_fd = -1;
+
+/* Index from interned StartupWMClass to app, sized for MAX_APPS so it
+   never needs to grow */
+#define CLASS_INDEX_SIZE (MAX_APPS * 2)
+static const char *class_keys[CLASS_INDEX_SIZE];
+static AppInfo *class_apps[CLASS_INDEX_SIZE];
+
+static int watch_fd = -1;
+static int watch_wd[APP_INDEX_DIRS];
+
+/**
+ * Whether a parsed .desktop file belongs in the launcher
+ */
+static bool is_listed(const DesktopEntry *entry) {
+    return entry->is_application && !entry->no_display && !entry->hidden &&
+           entry->name.len && entry->exec.len;
+}
+
+/**
+ * Unescaped copy of a .desktop value, interned. NULL on failure
+ */
+static const char *intern_value(DesktopValue value, bool exec) {
+    char *buf = malloc(value.len + 1);
+    if(!buf) return NULL;
+    mocha_desktop_value_unescape(value, exec, buf);
+    const char *s = mocha_intern(buf);
+    free(buf);
+    return s;
+}
+
+/**
+ * Resolve an Icon= value to a file, absolute paths are used as they are.
+ * Returns false if there is no such icon
+ */
+static bool find_icon_path(const char *icon_name, int size, char *path,
+                           size_t len) {
+    if(!icon_name || !icon_name[0]) return false;
+    if(icon_name[0] == '/')
+        return access(icon_name, F_OK) == 0 &&
+               snprintf(path, len, "%s", icon_name) < (int)len;
+    return mocha_icon_theme_lookup(icon_name, size, path, len);
+}
+
+/**
+ * An app's icon at size x size, NULL if it has none. The surface belongs
+ * to the icon cache and is only valid until the next lookup
+ */
+cairo_surface_t *load_app_icon(const AppInfo *app, int size) {
+    /* The path was resolved when the app table was built */
+    return mocha_icon_cache_get(app->icon_path, size);
+}
+
+static inline uint32_t hash_class(const char *interned) {
+    return (uint32_t)(((uint64_t)(uintptr_t)interned * 0x9E3779B97F4A7C15ull) >>
+                      32) &
+           (CLASS_INDEX_SIZE - 1);
+}
+
+static uint32_t class_slot(const char *key) {
+    uint32_t pos = hash_class(key);
+    while(class_keys[pos] && class_keys[pos] != key)
+        pos = (pos + 1) & (CLASS_INDEX_SIZE - 1);
+    return pos;
+}
+
+/**
+ * Index an app under its WM class, the first app claiming a class wins
+ */
+static void class_index_add(AppInfo *app) {
+    if(!app->name[0] || !app->wm_class[0]) return;
+    const char *key = mocha_intern(app->wm_class);
+    if(!key) return;
+    uint32_t pos = class_slot(key);
+    if(class_keys[pos]) return;
+    class_keys[pos] = key;
+    class_apps[pos] = app;
+}
+
+/**
+ * Drop an app from the index, backward-shifting the probe chain, and let
+ * another app with the same class take its place
+ */
+static void class_index_remove(AppInfo *app) {
+    const char *key = mocha_intern_find(app->wm_class);
+    if(!key) return;
+    uint32_t hole = class_slot(key);
+    if(!class_keys[hole] || class_apps[hole] != app) return;
+
+    const uint32_t mask = CLASS_INDEX_SIZE - 1;
+    for(uint32_t next = (hole + 1) & mask; class_keys[next];
+        next = (next + 1) & mask) {
+        uint32_t home = hash_class(class_keys[next]);
+        if(((next - home) & mask) < ((next - hole) & mask)) continue;
+        class_keys[hole] = class_keys[next];
+        class_apps[hole] = class_apps[next];
+        hole = next;
+    }
+    class_keys[hole] = NULL;
+    class_apps[hole] = NULL;
+
+    for(int i = 0; i < app_count; i++) {
+        if(&apps[i] != app && apps[i].name[0] &&
+           strcmp(apps[i].wm_class, app->wm_class) == 0) {
+            class_index_add(&apps[i]);
+            break;
         }
     }
 }
 
-void parse_desktop_file(const char *path, AppInfo *info) {
-    FILE *file = fopen(path, "r");
-    if(!file) return;
+/**
+ * Index the freshly bound apps[] and rebind everything holding AppInfo
+ * pointers into the old one
+ */
+static void build_class_index() {
+    memset(class_keys, 0, sizeof(class_keys));
+    memset(class_apps, 0, sizeof(class_apps));
+    for(int i = 0; i < app_count; i++) class_index_add(&apps[i]);
+    mocha_dock_bind_apps();
+}
 
-    char line[512];
-    info->icon_surface = NULL;
-    while(fgets(line, sizeof(line), file)) {
-        if(strncmp(line, "Name=", 5) == 0) {
-            sscanf(line, "Name=%[^\n]", info->name);
-        } else if(strncmp(line, "Exec=", 5) == 0) {
-            sscanf(line, "Exec=%[^\n]", info->exec);
-            cleanup_exec_command(info->exec);
-        } else if(strncmp(line, "Icon=", 5) == 0) {
-            sscanf(line, "Icon=%[^\n]", info->icon);
-        } else if(strncmp(line, "StartupWMClass=", 15) == 0) {
-            sscanf(line, "StartupWMClass=%[^\n]", info->wm_class);
-        } else if(strncmp(line, "NoDisplay=", 10) == 0) {
-            if(strstr(line, "true")) {
-                info->name[0] = '\0';
-            }
-        }
+/**
+ * Look up an app by an interned WM_CLASS, see mocha_intern()
+ */
+AppInfo *find_app_by_class(const char *wm_class) {
+    if(!wm_class) return NULL;
+    uint32_t pos = class_slot(wm_class);
+    return class_keys[pos] ? class_apps[pos] : NULL;
+}
+
+AppInfo *find_app_by_wmclass(const char *wm_class) {
+    /* A class that was never interned cannot belong to any app */
+    return find_app_by_class(mocha_intern_find(wm_class));
+}
+
+/**
+ * Append a string, returns its offset or 0 (the empty string) on failure
+ */
+static int reserve_strings(StringTable *t, size_t len) {
+    if(t->size + len <= t->cap) return 1;
+    if(len > UINT32_MAX / 2 - t->size) return 0;
+    uint32_t cap = t->cap * 2;
+    while(cap < t->size + len) cap *= 2;
+    char *grown = realloc(t->data, cap);
+    if(!grown) return 0;
+    t->data = grown;
+    t->cap = cap;
+    return 1;
+}
+
+static uint32_t add_string(StringTable *t, const char *str) {
+    if(!str || !str[0]) return 0;
+    uint32_t len = strlen(str) + 1;
+    if(!reserve_strings(t, len)) return 0;
+    uint32_t offset = t->size;
+    memcpy(t->data + offset, str, len);
+    t->size += len;
+    return offset;
+}
+
+/**
+ * Append a .desktop value, unescaping it straight into the table
+ */
+static uint32_t add_value(StringTable *t, DesktopValue value, bool exec) {
+    if(!value.len || !reserve_strings(t, value.len + 1)) return 0;
+    uint32_t offset = t->size;
+    size_t len = mocha_desktop_value_unescape(value, exec, t->data + offset);
+    if(!len) return 0;
+    t->size += len + 1;
+    return offset;
+}
+
+static int reset_strings(StringTable *t) {
+    if(!t->data) {
+        t->data = malloc(16384);
+        if(!t->data) return 0;
+        t->cap = 16384;
     }
-    fclose(file);
+    t->data[0] = '\0';
+    t->size = 1;
+    return 1;
 }
 
-static char *find_icon_path(const char *icon_name, int size) {
-    if(!icon_name || !icon_name[0]) return NULL;
+static int add_scan_job(uint32_t dir, const char *name) {
+    if(scan_job_count == scan_job_cap) {
+        uint32_t cap = scan_job_cap ? scan_job_cap * 2 : 256;
+        ScanJob *grown = realloc(scan_jobs, cap * sizeof(*grown));
+        if(!grown) return 0;
+        scan_jobs = grown;
+        scan_job_cap = cap;
+    }
+    uint32_t file = add_string(&scan_files, name);
+    if(!file) return 0;
+    scan_jobs[scan_job_count++] = (ScanJob){dir, file, -1, {0}};
+    return 1;
+}
 
-    char *path = malloc(1024);
-    const char *icon_themes[] = {"/usr/share/icons/hicolor",
-                                 "/usr/share/pixmaps", NULL};
-    const char *extensions[] = {".png", NULL};
+/**
+ * List the .desktop files of every app directory, in directory order
+ */
+static void collect_scan_jobs() {
+    scan_job_count = 0;
+    if(!reset_strings(&scan_files)) return;
+    for(uint32_t i = 0; i < APP_INDEX_DIRS; i++) {
+        if(!app_dir_paths[i][0]) continue;
+        DIR *dir = opendir(app_dir_paths[i]);
+        if(!dir) continue;
 
-    if(icon_name[0] == '/' && access(icon_name, F_OK) == 0) {
-        strncpy(path, icon_name, 1023);
-        return path;
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL) {
+            if(!strstr(entry->d_name, ".desktop")) continue;
+            if(!add_scan_job(i, entry->d_name)) break;
+        }
+        closedir(dir);
     }
+}
+
+/**
+ * Parse one file into a worker's string table
+ */
+static void scan_file(ScanJob *job, int worker) {
+    StringTable *t = &scan_workers[worker].strings;
+    char path[1024];
+    DesktopEntry info;
+    snprintf(path, sizeof(path), "%s/%s", app_dir_paths[job->dir],
+             scan_files.data + job->file);
+    if(!mocha_desktop_entry_open(path, &info)) return;
 
-    for(int t = 0; icon_themes[t]; t++) {
-        snprintf(path, 1024, "%s/%dx%d/apps/%s%s", icon_themes[t], size, size,
-                 icon_name, extensions[0]);
-        if(access(path, F_OK) == 0) return path;
-        snprintf(path, 1024, "%s/apps/%d/%s%s", icon_themes[t], size, icon_name,
-                 extensions[0]);
-        if(access(path, F_OK) == 0) return path;
-        snprintf(path, 1024, "%s/%s%s", icon_themes[t], icon_name,
-                 extensions[0]);
-        if(access(path, F_OK) == 0) return path;
+    bool listed = is_listed(&info);
+    AppRecord *r = &job->record;
+    if(listed) {
+        r->name = add_value(t, info.name, false);
+        r->exec = add_value(t, info.exec, true);
+        r->icon = add_value(t, info.icon, false);
+        r->wm_class = add_value(t, info.wm_class, false);
     }
+    mocha_desktop_entry_close(&info);
+    if(!listed) return;
 
-    snprintf(path, 1024, "/usr/share/pixmaps/%s%s", icon_name, extensions[0]);
-    if(access(path, F_OK) == 0) return path;
+    char icon_path[1024];
+    if(find_icon_path(t->data + r->icon, APP_ICON_SIZE, icon_path,
+                      sizeof(icon_path)))
+        r->icon_path = add_string(t, icon_path);
+    job->worker = worker;
+}
 
-    free(path);
+static void *scan_worker(void *arg) {
+    int worker = (int)(intptr_t)arg;
+    uint32_t i;
+    while((i = atomic_fetch_add(&scan_next, 1)) < scan_job_count)
+        scan_file(&scan_jobs[i], worker);
     return NULL;
 }
 
-static void rgba_to_cairo_argb32(unsigned char *data, int width, int height) {
-    for(int i = 0; i < width * height; ++i) {
-        uint8_t r = data[i * 4 + 0];
-        uint8_t g = data[i * 4 + 1];
-        uint8_t b = data[i * 4 + 2];
-        uint8_t a = data[i * 4 + 3];
-        double alpha = a / 255.0;
-        uint32_t r_pre = r * alpha;
-        uint32_t g_pre = g * alpha;
-        uint32_t b_pre = b * alpha;
-        ((uint32_t *)data)[i] =
-            (a << 24) | (r_pre << 16) | (g_pre << 8) | b_pre;
+static int scan_worker_count() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = scan_job_count / SCAN_FILES_PER_WORKER + 1;
+    if(cpus > 0 && n > cpus) n = cpus;
+    if(n > SCAN_MAX_WORKERS) n = SCAN_MAX_WORKERS;
+    return n;
+}
+
+static void scan_applications(AppTable *table, ScanResult *out) {
+    StringTable *scan_strings = &out->strings;
+    table->count = 0;
+    if(!reset_strings(scan_strings)) return;
+    collect_scan_jobs();
+
+    /* The calling thread is worker 0 */
+    int workers = scan_worker_count();
+    for(int i = 0; i < workers; i++) {
+        if(!reset_strings(&scan_workers[i].strings)) workers = i;
     }
+    if(workers == 0) return;
+    atomic_store(&scan_next, 0);
+    int started = 1;
+    while(started < workers &&
+          pthread_create(&scan_workers[started].thread, NULL, scan_worker,
+                         (void *)(intptr_t)started) == 0)
+        started++;
+    scan_worker((void *)(intptr_t)0);
+    for(int i = 1; i < started; i++) pthread_join(scan_workers[i].thread, NULL);
+
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < scan_job_count && count < MAX_APPS; i++) {
+        const ScanJob *job = &scan_jobs[i];
+        if(job->worker < 0) continue;
+        const char *strings = scan_workers[job->worker].strings.data;
+        AppRecord *r = &out->records[count++];
+        r->name = add_string(scan_strings, strings + job->record.name);
+        r->exec = add_string(scan_strings, strings + job->record.exec);
+        r->icon = add_string(scan_strings, strings + job->record.icon);
+        r->wm_class = add_string(scan_strings, strings + job->record.wm_class);
+        r->icon_path =
+            add_string(scan_strings, strings + job->record.icon_path);
+        r->file = add_string(scan_strings, scan_files.data + job->file);
+        r->dir = job->dir;
+    }
+    mocha_log("Scanned %u .desktop files with %d workers, %u apps",
+              scan_job_count, started, count);
+
+    table->records = out->records;
+    table->count = count;
+    table->strings = scan_strings->data;
+    table->strings_size = scan_strings->size;
+    table->map = NULL;
+    table->map_size = 0;
 }
 
-void load_app_icon(AppInfo *app, int size) {
-    if(app->icon_surface) return;
+/**
+ * Expand the app directories into app_dir_paths and stamp each with its
+ * mtime, 0 if it is missing
+ */
+static void resolve_app_dirs(int64_t mtimes[APP_INDEX_DIRS]) {
+    const char *home = getenv("HOME");
+    for(int i = 0; i < APP_INDEX_DIRS; i++) {
+        char *dir = app_dir_paths[i];
+        dir[0] = '\0';
+        if(app_dirs[i][0] != '~')
+            snprintf(dir, 1024, "%s", app_dirs[i]);
+        else if(home)
+            snprintf(dir, 1024, "%s%s", home, app_dirs[i] + 1);
 
-    char *icon_path = find_icon_path(app->icon, size);
-    if(!icon_path) {
+        struct stat st;
+        mtimes[i] = 0;
+        if(dir[0] && stat(dir, &st) == 0)
+            mtimes[i] =
+                (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+}
+
+static void bind_apps(const AppTable *table) {
+    /* A new table means a rescan, icon files may have changed too */
+    mocha_icon_cache_clear();
+
+    app_count = 0;
+    for(uint32_t i = 0; i < table->count && app_count < MAX_APPS; i++) {
+        const AppRecord *r = &table->records[i];
+        AppInfo *app = &apps[app_count];
+        app->name = table->strings + r->name;
+        app->exec = table->strings + r->exec;
+        app->icon = table->strings + r->icon;
+        app->wm_class = table->strings + r->wm_class;
+        app->icon_path = table->strings + r->icon_path;
+        app_file[app_count] = mocha_intern(table->strings + r->file);
+        app_dir[app_count] = r->dir;
+        app_count++;
+    }
+}
+
+/**
+ * Write the current app list to the index, so the next start maps it
+ * instead of rescanning after a watcher patch
+ */
+static void save_index(const char *path) {
+    StringTable strings = {0};
+    AppRecord *records = malloc(MAX_APPS * sizeof(*records));
+    if(!records || !reset_strings(&strings)) {
+        free(records);
+        free(strings.data);
         return;
     }
 
-    int w, h, n;
-    unsigned char *data = stbi_load(icon_path, &w, &h, &n, 4);
-    if(!data) {
-        free(icon_path);
+    AppTable table = {.records = records};
+    resolve_app_dirs(table.dir_mtimes);
+    table.icon_stamp = mocha_icon_theme_stamp();
+    for(int i = 0; i < app_count; i++) {
+        const AppInfo *app = &apps[i];
+        if(!app->name[0]) continue;
+        AppRecord *r = &records[table.count++];
+        r->name = add_string(&strings, app->name);
+        r->exec = add_string(&strings, app->exec);
+        r->icon = add_string(&strings, app->icon);
+        r->wm_class = add_string(&strings, app->wm_class);
+        r->icon_path = add_string(&strings, app->icon_path);
+        r->file = add_string(&strings, app_file[i]);
+        r->dir = app_dir[i];
+    }
+    table.strings = strings.data;
+    table.strings_size = strings.size;
+    mocha_app_index_save(path, &table);
+
+    free(records);
+    free(strings.data);
+}
+
+/**
+ * Scan results apps[] does not point into
+ */
+static ScanResult *spare_scan_result() {
+    return app_table.strings == scan_results[0].strings.data
+               ? &scan_results[1]
+               : &scan_results[0];
+}
+
+/**
+ * Scan every app directory into table and write a new index. Does not
+ * touch app_table, so it can run off the main thread
+ */
+static void scan_table(AppTable *table, const int64_t mtimes[APP_INDEX_DIRS]) {
+    scan_applications(table, spare_scan_result());
+    memcpy(table->dir_mtimes, mtimes, sizeof(table->dir_mtimes));
+    table->icon_stamp = mocha_icon_theme_stamp();
+
+    char index_path[1024];
+    if(mocha_app_index_path(index_path, sizeof(index_path)))
+        mocha_app_index_save(index_path, table);
+}
+
+/**
+ * Fill table from the cached index when the app directories are
+ * unchanged and by scanning them otherwise
+ */
+static void load_table(AppTable *table, const int64_t mtimes[APP_INDEX_DIRS]) {
+    char index_path[1024];
+    if(mocha_app_index_path(index_path, sizeof(index_path)) &&
+       mocha_app_index_load(index_path, mtimes, mocha_icon_theme_stamp(),
+                            table)) {
+        mocha_log("Loaded %u apps from %s", table->count, index_path);
         return;
     }
+    scan_table(table, mtimes);
+}
+
+/**
+ * Make a loaded table the app list, releasing the one it replaces
+ */
+static void publish_table(const AppTable *table) {
+    AppTable old = app_table;
+    app_table = *table;
+    bind_apps(&app_table);
+    build_class_index();
+    mocha_app_index_unmap(&old);
+    apps_loaded = true;
+}
 
-    rgba_to_cairo_argb32(data, w, h);
-    cairo_surface_t *icon_surface_full = cairo_image_surface_create_for_data(
-        data, CAIRO_FORMAT_ARGB32, w, h, w * 4);
+static void *load_worker(void *arg) {
+    if(load_scan)
+        scan_table(&load_result, load_mtimes);
+    else
+        load_table(&load_result, load_mtimes);
+    uint64_t one = 1;
+    if(write((int)(intptr_t)arg, &one, sizeof(one)) < 0) perror("apps write");
+    return NULL;
+}
 
-    app->icon_surface =
-        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
-    cairo_t *cr = cairo_create(app->icon_surface);
+/**
+ * Start the background loader, scan skips the index. Returns the eventfd
+ * it signals when done or -1
+ */
+static int start_loader(bool scan) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    resolve_app_dirs(load_mtimes);
+    load_scan = scan;
+    if(pthread_create(&load_thread, NULL, load_worker, (void *)(intptr_t)fd) !=
+       0) {
+        close(fd);
+        return -1;
+    }
+    load_pending = true;
+    load_stale = false;
+    load_fd = fd;
+    return fd;
+}
 
-    cairo_scale(cr, (double)size / w, (double)size / h);
-    cairo_set_source_surface(cr, icon_surface_full, 0, 0);
-    cairo_paint(cr);
+static void rescan_applications();
 
-    cairo_destroy(cr);
-    cairo_surface_destroy(icon_surface_full);
-    stbi_image_free(data);
-    free(icon_path);
+/**
+ * Wait for the background load and publish its table
+ */
+static void finish_loading() {
+    pthread_join(load_thread, NULL);
+    load_pending = false;
+    publish_table(&load_result);
+    if(load_stale) {
+        mocha_log("App directories changed while loading, rescanning");
+        rescan_applications();
+    }
 }
 
+/**
+ * Rescan the app directories in the background. apps[] stays as it is
+ * until the new table is published
+ */
+static void rescan_applications() {
+    if(load_pending) {
+        load_stale = true;
+        return;
+    }
+    int fd = start_loader(true);
+    if(fd < 0) {
+        mocha_log("Failed to start app rescan, keeping the current list");
+        return;
+    }
+    /* Without a watch nobody would pick the result up */
+    if(mocha_loop_add_fd(fd, mocha_apps_handle_loaded, NULL) < 0) {
+        finish_loading();
+        close(fd);
+    }
+}
+
+/**
+ * Start loading the app list on a background thread, returns an eventfd
+ * for the main loop or -1 if the list will be loaded on first use.
+ * Call after mocha_apps_watch_init() so changes made during the load are
+ * not lost
+ */
+int mocha_apps_load_async() {
+    if(apps_loaded || load_pending) return -1;
+    int fd = start_loader(false);
+    if(fd < 0) mocha_log("Failed to start app loader, loading on first use");
+    return fd;
+}
+
+/**
+ * Main loop callback for a loader's eventfd, each is only used once
+ */
+void mocha_apps_handle_loaded(int fd, void *data) {
+    uint64_t count;
+    if(read(fd, &count, sizeof(count)) < 0) return;
+    /* The launcher may have finished this load already */
+    if(load_pending && fd == load_fd) finish_loading();
+    mocha_loop_remove_fd(fd);
+    close(fd);
+}
+
+/**
+ * Load the app list. Waits for the background load if nothing has been
+ * loaded yet, a rescan in progress keeps serving the current list
+ */
 void find_applications() {
     if(apps_loaded) return;
-    const char *app_dirs[] = {"/usr/share/applications",
-                              "/usr/local/share/applications",
-                              "~/.local/share/applications", NULL};
-    app_count = 0;
+    if(load_pending) {
+        finish_loading();
+        return;
+    }
 
-    for(int i = 0; app_dirs[i] != NULL; i++) {
-        const char *dir_path = app_dirs[i];
-        if(dir_path[0] == '~') {
-            const char *home = getenv("HOME");
-            if(home) {
-                char path[1024];
-                snprintf(path, sizeof(path), "%s%s", home, dir_path + 1);
-                dir_path = strdup(path);
-            } else {
-                continue;
-            }
-        }
+    int64_t mtimes[APP_INDEX_DIRS];
+    resolve_app_dirs(mtimes);
+    load_table(&load_result, mtimes);
+    publish_table(&load_result);
+}
 
-        DIR *dir = opendir(dir_path);
-        if(!dir) {
-            if(app_dirs[i][0] == '~') free((void *)dir_path);
-            continue;
-        }
+/**
+ * Turn an app into a hole, its slot is reused if the same file comes back
+ */
+static void clear_app(int slot) {
+    AppInfo *app = &apps[slot];
+    class_index_remove(app);
+    app->name = app->exec = app->icon = app->wm_class = app->icon_path = "";
+}
 
-        struct dirent *entry;
-        while((entry = readdir(dir)) != NULL && app_count < MAX_APPS) {
-            if(strstr(entry->d_name, ".desktop")) {
-                char path[1024];
-                snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
-                parse_desktop_file(path, &apps[app_count]);
-                if(apps[app_count].name[0] && apps[app_count].exec[0]) {
-                    app_count++;
-                }
-            }
+/**
+ * Re-read one .desktop file and patch its entry, adding or clearing it
+ * as needed
+ */
+static void refresh_desktop_file(uint32_t dir, const char *name) {
+    const char *file = mocha_intern(name);
+    if(!file) return;
+    int slot = -1;
+    for(int i = 0; i < app_count; i++) {
+        if(app_file[i] == file && app_dir[i] == dir) {
+            slot = i;
+            break;
         }
-        closedir(dir);
-        if(app_dirs[i][0] == '~') free((void *)dir_path);
     }
-    apps_loaded = true;
+
+    char path[1024];
+    DesktopEntry info;
+    snprintf(path, sizeof(path), "%s/%s", app_dir_paths[dir], name);
+    bool listed = mocha_desktop_entry_open(path, &info) && is_listed(&info);
+    if(!listed) {
+        mocha_desktop_entry_close(&info);
+        if(slot >= 0) clear_app(slot);
+        return;
+    }
+
+    if(slot >= 0) {
+        clear_app(slot);
+    } else if(app_count < MAX_APPS) {
+        slot = app_count++;
+        app_file[slot] = file;
+        app_dir[slot] = dir;
+    } else {
+        mocha_log("App list full, ignoring %s", path);
+        mocha_desktop_entry_close(&info);
+        return;
+    }
+
+    AppInfo *app = &apps[slot];
+    app->name = intern_value(info.name, false);
+    app->exec = intern_value(info.exec, true);
+    app->icon = intern_value(info.icon, false);
+    app->wm_class = intern_value(info.wm_class, false);
+    mocha_desktop_entry_close(&info);
+
+    char icon_path[1024];
+    app->icon_path =
+        find_icon_path(app->icon, APP_ICON_SIZE, icon_path, sizeof(icon_path))
+            ? mocha_intern(icon_path)
+            : "";
+    if(!app->name || !app->exec || !app->icon || !app->wm_class ||
+       !app->icon_path) {
+        clear_app(slot);
+        return;
+    }
+    class_index_add(app);
 }
 
-AppInfo *find_app_by_wmclass(const char *wm_class) {
-    if(!wm_class) return NULL;
-    for(int i = 0; i < app_count; ++i) {
-        if(apps[i].wm_class[0] && strcmp(apps[i].wm_class, wm_class) == 0) {
-            return &apps[i];
+/**
+ * Start watching the app directories, returns an fd for the main loop or
+ * -1. Directories that do not exist yet are not watched
+ */
+int mocha_apps_watch_init() {
+    int64_t mtimes[APP_INDEX_DIRS];
+    resolve_app_dirs(mtimes);
+
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watch_fd < 0) {
+        perror("inotify_init1");
+        return -1;
+    }
+    for(int i = 0; i < APP_INDEX_DIRS; i++) {
+        watch_wd[i] = -1;
+        if(!app_dir_paths[i][0]) continue;
+        watch_wd[i] = inotify_add_watch(
+            watch_fd, app_dir_paths[i],
+            IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                IN_DELETE);
+    }
+    return watch_fd;
+}
+
+/**
+ * Patch the app list from queued inotify events. Only the .desktop files
+ * named by the events are re-read
+ */
+void mocha_apps_handle_watch(int fd, void *data) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0, overflow = 0;
+    ssize_t len;
+
+    while((len = read(fd, buf, sizeof(buf))) > 0) {
+        for(char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if(ev->mask & IN_Q_OVERFLOW) overflow = 1;
+            if(!ev->len || !strstr(ev->name, ".desktop")) continue;
+            /* A running loader replaces the table, patching it is wasted */
+            if(!apps_loaded || load_pending) {
+                changed = 1;
+                continue;
+            }
+            for(uint32_t i = 0; i < APP_INDEX_DIRS; i++) {
+                if(watch_wd[i] != ev->wd) continue;
+                refresh_desktop_file(i, ev->name);
+                changed = 1;
+                break;
+            }
         }
     }
-    return NULL;
-}
\ No newline at end of file
+
+    /* A running loader may have read the files before they changed. With
+       nothing loaded and no loader, a later load notices the change by
+       itself through the directory mtimes */
+    if(load_pending) {
+        if(changed || overflow) load_stale = true;
+        return;
+    }
+    if(!apps_loaded) return;
+    if(overflow) {
+        mocha_log("App watch overflowed, rescanning");
+        rescan_applications();
+        return;
+    }
+    if(!changed) return;
+    mocha_dock_bind_apps();
+    char index_path[1024];
+    if(mocha_app_index_path(index_path, sizeof(index_path)))
+        save_index(index_path);
+}
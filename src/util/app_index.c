@@ -0,0 +1,146 @@
+#include "util/app_index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+
+/*
+ * Binary app index, so a warm launcher start is one mmap instead of a
+ * directory scan plus a parse per .desktop file.
+ *
+ * Layout: header, records[count], strings[strings_size]. Strings are NUL
+ * terminated and records hold offsets into them. An index is only used if
+ * it was written for the same directory mtimes, which move whenever an
+ * entry is added, removed or renamed, and the same icon theme.
+ */
+
+#define APP_INDEX_MAGIC "MOCHAIDX"
+#define APP_INDEX_VERSION 3
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t strings_size;
+    uint32_t icon_stamp;
+    int64_t dir_mtimes[APP_INDEX_DIRS];
+} AppIndexHeader;
+
+/**
+ * Where the index lives, in the cache directory. Returns 0 if there is no
+ * usable location
+ */
+int mocha_app_index_path(char *buf, int len) {
+    return mocha_cache_path("apps.idx", buf, len);
+}
+
+static int index_valid(const AppIndexHeader *h, size_t size,
+                       const int64_t dir_mtimes[APP_INDEX_DIRS],
+                       uint32_t icon_stamp) {
+    if(memcmp(h->magic, APP_INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+       h->version != APP_INDEX_VERSION)
+        return 0;
+    if(memcmp(h->dir_mtimes, dir_mtimes, sizeof(h->dir_mtimes)) != 0 ||
+       h->icon_stamp != icon_stamp)
+        return 0;
+    if(h->strings_size == 0 ||
+       size != sizeof(*h) + (size_t)h->count * sizeof(AppRecord) +
+                   h->strings_size)
+        return 0;
+
+    const AppRecord *records = (const AppRecord *)(h + 1);
+    const char *strings = (const char *)(records + h->count);
+    if(strings[h->strings_size - 1] != '\0') return 0;
+    for(uint32_t i = 0; i < h->count; i++) {
+        const AppRecord *r = &records[i];
+        if(r->name >= h->strings_size || r->exec >= h->strings_size ||
+           r->icon >= h->strings_size || r->wm_class >= h->strings_size ||
+           r->icon_path >= h->strings_size || r->file >= h->strings_size ||
+           r->dir >= APP_INDEX_DIRS)
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Map the index if it matches dir_mtimes and icon_stamp. The mapping
+ * stays alive for as long as out is in use, returns 1 on success
+ */
+int mocha_app_index_load(const char *path,
+                         const int64_t dir_mtimes[APP_INDEX_DIRS],
+                         uint32_t icon_stamp, AppTable *out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(AppIndexHeader)) {
+        close(fd);
+        return 0;
+    }
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return 0;
+
+    const AppIndexHeader *h = map;
+    if(!index_valid(h, size, dir_mtimes, icon_stamp)) {
+        munmap(map, size);
+        return 0;
+    }
+
+    out->records = (const AppRecord *)(h + 1);
+    out->count = h->count;
+    out->strings = (const char *)(out->records + h->count);
+    out->strings_size = h->strings_size;
+    memcpy(out->dir_mtimes, h->dir_mtimes, sizeof(out->dir_mtimes));
+    out->icon_stamp = h->icon_stamp;
+    out->map = map;
+    out->map_size = size;
+    return 1;
+}
+
+/**
+ * Release a mapped table, nothing may point into it afterwards
+ */
+void mocha_app_index_unmap(AppTable *table) {
+    if(table->map) munmap(table->map, table->map_size);
+    table->map = NULL;
+    table->map_size = 0;
+}
+
+/**
+ * Write table to path, atomically replacing any previous index so a
+ * process still mapping the old one is unaffected
+ */
+int mocha_app_index_save(const char *path, const AppTable *table) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if(!f) return 0;
+
+    AppIndexHeader h = {0};
+    memcpy(h.magic, APP_INDEX_MAGIC, sizeof(h.magic));
+    h.version = APP_INDEX_VERSION;
+    h.count = table->count;
+    h.strings_size = table->strings_size;
+    memcpy(h.dir_mtimes, table->dir_mtimes, sizeof(h.dir_mtimes));
+    h.icon_stamp = table->icon_stamp;
+
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(table->records, sizeof(AppRecord), table->count, f);
+    fwrite(table->strings, 1, table->strings_size, f);
+    int failed = ferror(f);
+    if(fclose(f) != 0) failed = 1;
+    if(failed || rename(tmp, path) < 0) {
+        mocha_log("App index: failed to write %s", path);
+        unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
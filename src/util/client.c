@@ -14,6 +14,13 @@
 #include "features/launcher.h"
 #include "util/app.h"
 #include "util/config.h"
+#include "util/intern.h"
+#include "util/layout.h"
+#include "util/monitor.h"
+#include "util/shm_image.h"
+#include "util/spawn.h"
+#include "util/stats.h"
+#include "util/workspace.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "lib/stb_image.h"
 
@@ -26,39 +33,145 @@ extern Display *dpy;
 extern unsigned long border_color, focus_color, panel_color, foreground_color,
     accent_color;
 
-ClientState client_states[MAX_CLIENTS] = {0};
-Window managed_clients[MAX_CLIENTS];
-int num_managed_clients = 0;
-
 DockIcon dock_icons[MAX_DOCK_ICONS] = {0};
 int num_dock_icons = 0;
 
+/* Workspace indicators at the right end of the dock */
+#define WORKSPACE_DOT_SIZE 10
+static int workspace_dot_x[MAX_WORKSPACES];
+static int workspace_dot_y;
+
 ClientState *mocha_get_client_state(Window w) {
-    return &client_states[w % MAX_CLIENTS];
+    Client *c = mocha_client_find(w);
+    return c ? &c->state : NULL;
 }
 
 /**
  * Add a managed client
  */
-void mocha_add_managed_client(Window w) {
-    if(num_managed_clients < MAX_CLIENTS) {
-        managed_clients[num_managed_clients++] = w;
-    }
-}
+void mocha_add_managed_client(Window w) { mocha_client_add(w); }
 
 /**
  * Remove a managed client
  */
 void mocha_remove_managed_client(Window w) {
-    for(int i = 0; i < num_managed_clients; i++) {
-        if(managed_clients[i] == w) {
-            for(int j = i; j < num_managed_clients - 1; j++) {
-                managed_clients[j] = managed_clients[j + 1];
-            }
-            num_managed_clients--;
+    Client *c = mocha_client_find(w);
+    if(!c) return;
+    mocha_workspace_detach(c);
+    mocha_client_remove(w);
+}
+
+/**
+ * Fill a client's geometry cache from the server, needed once when the
+ * client is first managed
+ */
+void mocha_client_fetch_geometry(Client *c) {
+    XWindowAttributes attr;
+    mocha_stats_roundtrip();
+    if(!XGetWindowAttributes(dpy, c->window, &attr)) return;
+    c->x = attr.x;
+    c->y = attr.y;
+    c->w = attr.width;
+    c->h = attr.height;
+    c->border = attr.border_width;
+    c->mapped = attr.map_state != IsUnmapped;
+    c->has_geometry = 1;
+}
+
+/**
+ * Move and resize a client, keeping its geometry cache in step
+ */
+void mocha_client_move_resize(Client *c, int x, int y, int w, int h) {
+    c->configure_serial = NextRequest(dpy);
+    XMoveResizeWindow(dpy, c->window, x, y, w, h);
+    c->x = x;
+    c->y = y;
+    c->w = w;
+    c->h = h;
+}
+
+void mocha_client_move(Client *c, int x, int y) {
+    c->configure_serial = NextRequest(dpy);
+    XMoveWindow(dpy, c->window, x, y);
+    c->x = x;
+    c->y = y;
+}
+
+void mocha_client_resize(Client *c, int w, int h) {
+    c->configure_serial = NextRequest(dpy);
+    XResizeWindow(dpy, c->window, w, h);
+    c->w = w;
+    c->h = h;
+}
+
+void mocha_client_set_border(Client *c, int border) {
+    c->configure_serial = NextRequest(dpy);
+    XSetWindowBorderWidth(dpy, c->window, border);
+    c->border = border;
+}
+
+/**
+ * Update the geometry cache from structure notifications
+ */
+void mocha_client_track_event(const XEvent *e) {
+    Client *c;
+    switch(e->type) {
+        case ConfigureNotify:
+            c = mocha_client_find(e->xconfigure.window);
+            /* Notifies generated before our latest configure are stale */
+            if(!c || e->xconfigure.serial < c->configure_serial) return;
+            c->x = e->xconfigure.x;
+            c->y = e->xconfigure.y;
+            c->w = e->xconfigure.width;
+            c->h = e->xconfigure.height;
+            c->border = e->xconfigure.border_width;
+            c->has_geometry = 1;
+            break;
+        case MapNotify:
+            c = mocha_client_find(e->xmap.window);
+            if(c) c->mapped = 1;
+            break;
+        case UnmapNotify:
+            c = mocha_client_find(e->xunmap.window);
+            if(c) c->mapped = 0;
+            break;
+    }
+}
+
+/**
+ * Debug helper, compares one cached client against the server every so
+ * often and logs any drift
+ */
+void mocha_client_verify_geometry() {
+    static unsigned long calls = 0;
+    static uint32_t next_slot = 0;
+    if(++calls % 128 != 0 || num_managed_clients == 0) return;
+
+    Client *c = NULL;
+    for(Client *it = mocha_client_first(); it; it = mocha_client_next(it)) {
+        if(!c) c = it;
+        if(it->slot >= next_slot) {
+            c = it;
             break;
         }
     }
+    next_slot = c->slot + 1;
+
+    XWindowAttributes attr;
+    mocha_stats_roundtrip();
+    mocha_trap_errors();
+    Status ok = XGetWindowAttributes(dpy, c->window, &attr);
+    if(mocha_untrap_errors() || !ok) return;
+    if(attr.x != c->x || attr.y != c->y || attr.width != c->w ||
+       attr.height != c->h || attr.border_width != c->border ||
+       (attr.map_state != IsUnmapped) != c->mapped) {
+        mocha_log(
+            "Geometry drift on 0x%lx: cached %dx%d+%d+%d b%d m%d, server "
+            "%dx%d+%d+%d b%d m%d",
+            c->window, c->w, c->h, c->x, c->y, c->border, c->mapped,
+            attr.width, attr.height, attr.x, attr.y, attr.border_width,
+            attr.map_state != IsUnmapped);
+    }
 }
 
 /**
@@ -66,21 +179,24 @@ void mocha_remove_managed_client(Window w) {
  */
 char *mocha_get_client_name(Window w) {
     char *name = NULL;
+    mocha_stats_roundtrip();
     if(XFetchName(dpy, w, &name) > 0 && name != NULL) {
         return name;
     }
     return "(Mocha Window)";
 }
 
-static char *get_wm_class(Window win) {
+/**
+ * Read a client's WM_CLASS once, stored interned in c->wm_class
+ */
+void mocha_client_fetch_class(Client *c) {
     XClassHint class_hint;
-    if(XGetClassHint(dpy, win, &class_hint)) {
-        char *wm_class = strdup(class_hint.res_class);
+    mocha_stats_roundtrip();
+    if(XGetClassHint(dpy, c->window, &class_hint)) {
+        c->wm_class = mocha_intern(class_hint.res_class);
         XFree(class_hint.res_name);
         XFree(class_hint.res_class);
-        return wm_class;
     }
-    return NULL;
 }
 
 int is_dialog(Window w) {
@@ -88,12 +204,16 @@ int is_dialog(Window w) {
     int format;
     unsigned long nitems, bytes_after;
     unsigned char *prop;
-    Atom dialog_atom = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
+    static Atom type_atom = None, dialog_atom = None;
+    if(type_atom == None) {
+        type_atom = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
+        dialog_atom = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
+    }
 
-    if(XGetWindowProperty(dpy, w,
-                          XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False), 0,
-                          sizeof(Atom), False, XA_ATOM, &type, &format, &nitems,
-                          &bytes_after, &prop) == Success &&
+    mocha_stats_roundtrip();
+    if(XGetWindowProperty(dpy, w, type_atom, 0, sizeof(Atom), False, XA_ATOM,
+                          &type, &format, &nitems, &bytes_after,
+                          &prop) == Success &&
        prop) {
         Atom window_type = *(Atom *)prop;
         XFree(prop);
@@ -106,50 +226,79 @@ int is_dialog(Window w) {
 }
 
 /**
- * A util to tile windows/clients
+ * Ask for a retile of one monitor at the end of the current event batch
  */
-void mocha_tile_clients(int taskbar_height) {
-    ClientState *c;
-    Window w;
-    int count = 0;
-    int screen = DefaultScreen(dpy);
+void mocha_request_retile_monitor(int monitor) {
+    if(monitor < 0 || monitor >= num_monitors) return;
+    if(monitors[monitor].dirty) mocha_stats.retiles_coalesced++;
+    monitors[monitor].dirty = 1;
+}
 
-    mocha_for_each_client(c, w) { count++; }
-    mocha_for_each_client_end
+/**
+ * Ask for a retile of the monitor a client is tiled on. Clients on a hidden
+ * workspace wait for that workspace to be shown
+ */
+void mocha_request_retile_client(const Client *c) {
+    if(c->workspace == current_workspace)
+        mocha_request_retile_monitor(c->monitor);
+    else
+        workspaces[c->workspace].dirty |= 1u << c->monitor;
+}
 
-        if(count == 0) return;
+/**
+ * Ask for a retile of every monitor
+ */
+void mocha_request_retile() {
+    for(int i = 0; i < num_monitors; i++) mocha_request_retile_monitor(i);
+}
 
-    int screen_w = DisplayWidth(dpy, screen);
-    int screen_h = DisplayHeight(dpy, screen) - taskbar_height;
+/**
+ * Resolve pending retiles, called once per event batch. Only dirty
+ * monitors get a layout pass
+ */
+void mocha_flush_retile(int taskbar_height, int tiling_enabled) {
+    for(int i = 0; i < num_monitors; i++) {
+        if(!monitors[i].dirty) continue;
+        monitors[i].dirty = 0;
+        if(tiling_enabled)
+            mocha_stats_layout_pass(mocha_tile_monitor(i, taskbar_height));
+    }
+}
 
-    int gap = 10;
-    int usable_w = (int)(screen_w * 0.95) - 2 * gap;
-    int usable_h = (int)(screen_h * 0.95) - 2 * gap;
-    int offset_x = (screen_w - usable_w) / 2;
-    int offset_y = (screen_h - usable_h) / 2;
-
-    int master_w = count > 1 ? usable_w / 2 - gap / 2 : usable_w;
-    int stack_w = usable_w - master_w - gap;
-    int stack_count = count - 1;
-    int stack_h = stack_count > 0
-                      ? (usable_h - (stack_count - 1) * gap) / stack_count
-                      : 0;
-
-    int i = 0;
-    mocha_for_each_client(c, w) {
-        if(i == 0) {
-            XMoveResizeWindow(dpy, w, offset_x, offset_y,
-                              master_w - 2 * get_border_width(),
-                              usable_h - 2 * get_border_width());
-        } else {
-            XMoveResizeWindow(dpy, w, offset_x + master_w + gap,
-                              offset_y + (i - 1) * (stack_h + gap),
-                              stack_w - 2 * get_border_width(),
-                              stack_h - 2 * get_border_width());
+/**
+ * Tile the current workspace's clients on one monitor, returns how many
+ * were reconfigured
+ */
+int mocha_tile_monitor(int monitor, int taskbar_height) {
+    static Client **tiled = NULL;
+    static int tiled_cap = 0;
+    int count = 0;
+
+    for(Client *c = workspaces[current_workspace].first; c; c = c->ws_next) {
+        if(c->monitor != monitor) continue;
+        if(c->state.is_minimized || c->state.is_fullscreen) continue;
+        if(count == tiled_cap) {
+            int cap = tiled_cap ? tiled_cap * 2 : 32;
+            Client **grown = realloc(tiled, cap * sizeof(*grown));
+            if(!grown) break;
+            tiled = grown;
+            tiled_cap = cap;
         }
-        i++;
+        tiled[count++] = c;
     }
-    mocha_for_each_client_end
+    if(count == 0) return 0;
+
+    const Monitor *mon = &monitors[monitor];
+    /* The taskbar sits at the bottom of the primary monitor */
+    int mon_h = mon->h - (monitor == 0 ? taskbar_height : 0);
+
+    int gap = 10;
+    int usable_w = (int)(mon->w * 0.95) - 2 * gap;
+    int usable_h = (int)(mon_h * 0.95) - 2 * gap;
+    MochaRect area = {mon->x + (mon->w - usable_w) / 2,
+                      mon->y + (mon_h - usable_h) / 2, usable_w, usable_h};
+
+    return mocha_layout_apply(mon->layout, &area, gap, tiled, count);
 }
 
 /**
@@ -214,144 +363,292 @@ static void draw_circular_icon(cairo_t *cr, int x, int y, int size,
 void mocha_init_dock() {
     num_dock_icons = 0;
 
-    mocha_add_dock_icon("Launcher", "");
-    mocha_add_dock_icon("Terminal", "ghostty");
-    mocha_add_dock_icon("Browser", "chromium");
-    mocha_add_dock_icon("Files", "thunar");
+    mocha_add_dock_icon("Launcher", "", "");
+    mocha_add_dock_icon("Terminal", "ghostty", "com.mitchellh.ghostty");
+    mocha_add_dock_icon("Browser", "chromium", "Chromium");
+    mocha_add_dock_icon("Files", "thunar", "Thunar");
 
-    for(int i = 0; i < num_dock_icons; i++) {
-        dock_icons[i].app = find_app_by_wmclass(dock_icons[i].name);
-    }
+    /* Apps are bound again whenever the app list changes */
+    mocha_dock_bind_apps();
 }
 
 /**
  * Add an icon to the dock
  */
-void mocha_add_dock_icon(const char *name, const char *command) {
+void mocha_add_dock_icon(const char *name, const char *command,
+                         const char *wm_class) {
     if(num_dock_icons >= MAX_DOCK_ICONS) return;
 
     DockIcon *icon = &dock_icons[num_dock_icons++];
     strncpy(icon->name, name, sizeof(icon->name) - 1);
     strncpy(icon->command, command, sizeof(icon->command) - 1);
+    strncpy(icon->wm_class, wm_class, sizeof(icon->wm_class) - 1);
     icon->is_running = 0;
+    icon->dirty = true;
     icon->window = None;
 }
 
+/* Persistent dock back-buffer, only rebuilt when the dock changes size.
+   It is a shared memory image when the server supports MIT-SHM, so
+   drawing stays client side and a repaint is one small put per region,
+   otherwise a pixmap cairo draws into with XRender */
+#define DOCK_HEIGHT 60
+#define DOCK_PADDING 6
+#define DOCK_ICON_SIZE 28
+#define DOCK_ICON_SPACING 8
+#define DOCK_LAUNCHER_SIZE 32
+static Pixmap dock_pixmap = None;
+static ShmImage dock_image;
+static cairo_surface_t *dock_surface = NULL;
+static cairo_t *dock_cr = NULL;
+static GC dock_gc = None;
+/* Window the dock was last drawn into, for repaints not caused by X */
+static Window dock_window = None;
+static int dock_width = 0;
+/* Workspace indicator state last painted into the back-buffer */
+static int drawn_workspace = -1;
+static int drawn_occupied[MAX_WORKSPACES];
+
+static void dock_free_buffer() {
+    if(dock_cr) cairo_destroy(dock_cr);
+    if(dock_surface) cairo_surface_destroy(dock_surface);
+    if(dock_pixmap != None) XFreePixmap(dpy, dock_pixmap);
+    if(dock_image.surface) mocha_shm_image_destroy(&dock_image);
+    dock_cr = NULL;
+    dock_surface = NULL;
+    dock_pixmap = None;
+    dock_width = 0;
+}
+
 /**
- * Draw the dock with app icons using Cairo
+ * (Re)create the back-buffer for a dock of the given width
  */
-void mocha_draw_dock(Window dock_win) {
-    XWindowAttributes win_attrs;
-    XGetWindowAttributes(dpy, dock_win, &win_attrs);
-    int screen_w = DisplayWidth(dpy, screen);
-    int screen_h = DisplayHeight(dpy, screen);
-    int depth = win_attrs.depth;
-    Visual *visual = win_attrs.visual;
-
-    XSync(dpy, False);
-
-    Pixmap pixmap = XCreatePixmap(dpy, dock_win, screen_w, 60, depth);
-    if(pixmap == None) {
-        mocha_log("Failed to create pixmap for dock rendering");
-        return;
+static int dock_create_buffer(Window dock_win, int width) {
+    /* The taskbar is created with the default depth and visual */
+    int depth = DefaultDepth(dpy, screen);
+    Visual *visual = DefaultVisual(dpy, screen);
+
+    dock_free_buffer();
+    if(mocha_shm_available() &&
+       mocha_shm_image_create(&dock_image, visual, depth, width, DOCK_HEIGHT) &&
+       dock_image.shared) {
+        dock_surface = cairo_surface_reference(dock_image.surface);
+    } else {
+        if(dock_image.surface) mocha_shm_image_destroy(&dock_image);
+        mocha_trap_errors();
+        dock_pixmap = XCreatePixmap(dpy, dock_win, width, DOCK_HEIGHT, depth);
+        if(mocha_untrap_errors() || dock_pixmap == None) {
+            mocha_log("Failed to create pixmap for dock rendering");
+            dock_pixmap = None;
+            return 0;
+        }
+        dock_surface = cairo_xlib_surface_create(dpy, dock_pixmap, visual,
+                                                 width, DOCK_HEIGHT);
+    }
+    if(cairo_surface_status(dock_surface) != CAIRO_STATUS_SUCCESS) {
+        mocha_log("Failed to create Cairo surface");
+        dock_free_buffer();
+        return 0;
     }
 
-    XErrorHandler old_handler = XSetErrorHandler(NULL);
+    dock_cr = cairo_create(dock_surface);
+    if(cairo_status(dock_cr) != CAIRO_STATUS_SUCCESS) {
+        mocha_log("Failed to create Cairo context: %s",
+                  cairo_status_to_string(cairo_status(dock_cr)));
+        dock_free_buffer();
+        return 0;
+    }
 
-    cairo_surface_t *surface =
-        cairo_xlib_surface_create(dpy, pixmap, visual, screen_w, 60);
+    if(dock_gc == None) dock_gc = XCreateGC(dpy, dock_win, 0, NULL);
+    dock_width = width;
+    return 1;
+}
 
-    XSetErrorHandler(old_handler);
-    XSync(dpy, False);
+/**
+ * Place the icons for the current dock width
+ */
+static void dock_layout_icons() {
+    dock_icons[0].x = DOCK_PADDING;
+    dock_icons[0].y = (DOCK_HEIGHT - DOCK_LAUNCHER_SIZE) / 2;
 
-    if(surface == NULL ||
-       cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
-        mocha_log("Failed to create Cairo surface");
-        XFreePixmap(dpy, pixmap);
-        if(surface) cairo_surface_destroy(surface);
-        return;
+    int app_icons_width =
+        (num_dock_icons - 1) * (DOCK_ICON_SIZE + DOCK_ICON_SPACING) -
+        DOCK_ICON_SPACING;
+    int center_start_x =
+        (dock_width - app_icons_width) / 2 + DOCK_LAUNCHER_SIZE;
+    for(int i = 1; i < num_dock_icons; i++) {
+        dock_icons[i].x =
+            center_start_x + (i - 1) * (DOCK_ICON_SIZE + DOCK_ICON_SPACING);
+        dock_icons[i].y = (DOCK_HEIGHT - DOCK_ICON_SIZE) / 2;
     }
 
-    cairo_t *cr = cairo_create(surface);
+    for(int i = 0; i < num_workspaces; i++)
+        workspace_dot_x[i] = dock_width - DOCK_PADDING -
+                             (num_workspaces - i) * (WORKSPACE_DOT_SIZE + 8);
+    workspace_dot_y = (DOCK_HEIGHT - WORKSPACE_DOT_SIZE) / 2;
+}
 
-    if(cairo_status(cr) != CAIRO_STATUS_SUCCESS) {
-        mocha_log("Failed to create Cairo context: %s",
-                  cairo_status_to_string(cairo_status(cr)));
-        cairo_destroy(cr);
-        cairo_surface_destroy(surface);
-        XFreePixmap(dpy, pixmap);
-        return;
-    }
+/**
+ * Rectangle an icon paints into, including its running indicator
+ */
+static void dock_icon_rect(int i, int *x, int *y, int *w, int *h) {
+    int size = i == 0 ? DOCK_LAUNCHER_SIZE : DOCK_ICON_SIZE;
+    *x = dock_icons[i].x - 2;
+    *y = dock_icons[i].y - 2;
+    *w = size + 4;
+    *h = size + 10;
+}
 
-    cairo_set_source_rgba(cr, 0, 0, 0, 0);
+/**
+ * Clip to a rectangle and repaint the dock background under it
+ */
+static void dock_begin_region(int x, int y, int w, int h) {
+    cairo_t *cr = dock_cr;
+    cairo_save(cr);
+    cairo_rectangle(cr, x, y, w, h);
+    cairo_clip(cr);
     cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
     cairo_paint(cr);
     cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+    cairo_set_source_rgba(cr, 0.1, 0.1, 0.1, 0.75);
+    cairo_paint(cr);
+}
 
-    int icon_size = 28;
-    int icon_spacing = 8;
-    int dock_padding = 6;
-    int dock_height = 60;
-
-    int dock_width = screen_w;
+/* Copy a region of the back-buffer to the dock window */
+static void dock_present(Window dock_win, int x, int y, int w, int h) {
+    if(dock_image.surface) {
+        mocha_shm_image_put(&dock_image, dock_win, dock_gc, x, y, w, h);
+    } else {
+        cairo_surface_flush(dock_surface);
+        XCopyArea(dpy, dock_pixmap, dock_win, dock_gc, x, y, w, h, x, y);
+    }
+}
 
-    int dock_x = 0;
-    int dock_y = 0;
+static void dock_end_region(Window dock_win, int x, int y, int w, int h) {
+    cairo_restore(dock_cr);
+    dock_present(dock_win, x, y, w, h);
+}
 
-    cairo_set_source_rgba(cr, 0.1, 0.1, 0.1, 0.75);
-    cairo_rectangle(cr, dock_x, dock_y, dock_width, dock_height);
-    cairo_fill(cr);
+static void dock_paint_icon(int i) {
+    cairo_t *cr = dock_cr;
+    DockIcon *icon = &dock_icons[i];
 
-    int launcher_icon_size = 32;
-    int launcher_icon_x = dock_x + dock_padding;
-    int launcher_icon_y = dock_y + (dock_height - launcher_icon_size) / 2;
+    if(i == 0) {
+        draw_circular_icon(cr, icon->x, icon->y, DOCK_LAUNCHER_SIZE, 0x808080,
+                           "L", true);
+        return;
+    }
 
-    draw_circular_icon(cr, launcher_icon_x, launcher_icon_y, launcher_icon_size,
-                       0x808080, "L", true);
-    dock_icons[0].x = launcher_icon_x;
-    dock_icons[0].y = launcher_icon_y;
+    cairo_surface_t *surface =
+        icon->app ? load_app_icon(icon->app, DOCK_ICON_SIZE) : NULL;
+    if(surface) {
+        cairo_save(cr);
+        cairo_set_source_surface(cr, surface, icon->x, icon->y);
+        cairo_paint(cr);
+        cairo_restore(cr);
+    } else {
+        draw_circular_icon(cr, icon->x, icon->y, DOCK_ICON_SIZE, accent_color,
+                           icon->name, false);
+    }
 
-    int app_icons_width =
-        (num_dock_icons - 1) * (icon_size + icon_spacing) - icon_spacing;
-    int center_start_x =
-        dock_x + (dock_width - app_icons_width) / 2 + launcher_icon_size;
+    if(icon->is_running) {
+        cairo_set_source_rgba(cr, 1, 1, 1, 0.8);
+        cairo_arc(cr, icon->x + DOCK_ICON_SIZE / 2.0,
+                  icon->y + DOCK_ICON_SIZE + 4, 2, 0, 2 * M_PI);
+        cairo_fill(cr);
+    }
+}
 
-    for(int i = 1; i < num_dock_icons; i++) {
-        int icon_x = center_start_x + (i - 1) * (icon_size + icon_spacing);
-        int icon_y = dock_y + (dock_height - icon_size) / 2;
-
-        if(dock_icons[i].app) {
-            load_app_icon(dock_icons[i].app, icon_size);
-            if(dock_icons[i].app->icon_surface) {
-                cairo_save(cr);
-                cairo_set_source_surface(cr, dock_icons[i].app->icon_surface,
-                                         icon_x, icon_y);
-                cairo_paint(cr);
-                cairo_restore(cr);
-            } else {
-                draw_circular_icon(cr, icon_x, icon_y, icon_size, accent_color,
-                                   dock_icons[i].name, false);
-            }
+static void dock_paint_workspaces() {
+    cairo_t *cr = dock_cr;
+    double radius = WORKSPACE_DOT_SIZE / 2.0;
+    for(int i = 0; i < num_workspaces; i++) {
+        cairo_arc(cr, workspace_dot_x[i] + radius, workspace_dot_y + radius,
+                  radius, 0, 2 * M_PI);
+        if(i == current_workspace) {
+            cairo_set_source_rgba(cr, ((accent_color >> 16) & 0xFF) / 255.0,
+                                  ((accent_color >> 8) & 0xFF) / 255.0,
+                                  (accent_color & 0xFF) / 255.0, 1);
+            cairo_fill(cr);
+        } else if(workspaces[i].count > 0) {
+            cairo_set_source_rgba(cr, 1, 1, 1, 0.8);
+            cairo_fill(cr);
         } else {
-            draw_circular_icon(cr, icon_x, icon_y, icon_size, accent_color,
-                               dock_icons[i].name, false);
+            cairo_set_source_rgba(cr, 1, 1, 1, 0.4);
+            cairo_set_line_width(cr, 1.5);
+            cairo_stroke(cr);
         }
-
-        dock_icons[i].x = icon_x;
-        dock_icons[i].y = icon_y;
+        drawn_occupied[i] = workspaces[i].count > 0;
     }
+    drawn_workspace = current_workspace;
+}
+
+static int dock_workspaces_changed() {
+    if(drawn_workspace != current_workspace) return 1;
+    for(int i = 0; i < num_workspaces; i++)
+        if(drawn_occupied[i] != (workspaces[i].count > 0)) return 1;
+    return 0;
+}
 
-    cairo_surface_flush(surface);
+/**
+ * Bring the dock up to date. Only dirty icons and a changed workspace
+ * strip are repainted and copied, the whole back-buffer is redrawn only
+ * after a resize
+ */
+void mocha_draw_dock(Window dock_win) {
+    /* The taskbar spans the primary monitor */
+    int width = monitors[0].w;
+    int full = 0;
+    dock_window = dock_win;
+    if(!dock_surface || width != dock_width) {
+        if(!dock_create_buffer(dock_win, width)) return;
+        dock_layout_icons();
+        full = 1;
+    }
+    /* Earlier puts must be read before their pixels are drawn over */
+    if(dock_image.surface) mocha_shm_image_wait(&dock_image);
+
+    if(full) {
+        dock_begin_region(0, 0, dock_width, DOCK_HEIGHT);
+        for(int i = 0; i < num_dock_icons; i++) {
+            dock_paint_icon(i);
+            dock_icons[i].dirty = false;
+        }
+        if(num_workspaces > 1) dock_paint_workspaces();
+        dock_end_region(dock_win, 0, 0, dock_width, DOCK_HEIGHT);
+        return;
+    }
 
-    GC gc = XCreateGC(dpy, dock_win, 0, NULL);
-    XCopyArea(dpy, pixmap, dock_win, gc, 0, 0, screen_w, 60, 0, 0);
-    XFreeGC(dpy, gc);
+    for(int i = 0; i < num_dock_icons; i++) {
+        if(!dock_icons[i].dirty) continue;
+        int x, y, w, h;
+        dock_icon_rect(i, &x, &y, &w, &h);
+        dock_begin_region(x, y, w, h);
+        dock_paint_icon(i);
+        dock_end_region(dock_win, x, y, w, h);
+        dock_icons[i].dirty = false;
+    }
 
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
-    XFreePixmap(dpy, pixmap);
+    if(num_workspaces > 1 && dock_workspaces_changed()) {
+        int x = workspace_dot_x[0] - 2;
+        int w = dock_width - DOCK_PADDING + 2 - x;
+        int y = workspace_dot_y - 2;
+        int h = WORKSPACE_DOT_SIZE + 4;
+        dock_begin_region(x, y, w, h);
+        dock_paint_workspaces();
+        dock_end_region(dock_win, x, y, w, h);
+    }
+}
 
-    XSync(dpy, False);
+/**
+ * Serve an Expose from the back-buffer, copying only the exposed area
+ */
+void mocha_dock_expose(Window dock_win, const XExposeEvent *e) {
+    if(!dock_surface || monitors[0].w != dock_width) {
+        mocha_draw_dock(dock_win);
+        return;
+    }
+    dock_present(dock_win, e->x, e->y, e->width, e->height);
 }
 
 /**
@@ -369,100 +666,71 @@ void mocha_handle_dock_click(int x, int y) {
             if(strcmp(dock_icons[i].name, "Launcher") == 0) {
                 mocha_launch_menu();
             } else {
-                char cmd[300];
-                snprintf(cmd, sizeof(cmd), "%s &", dock_icons[i].command);
-                system(cmd);
+                mocha_spawn(dock_icons[i].command);
             }
             return;
         }
     }
-}
 
-void mocha_update_dock_icons() {
-    for(int i = 0; i < num_dock_icons; i++) {
-        dock_icons[i].is_running = 0;
+    for(int i = 0; num_workspaces > 1 && i < num_workspaces; i++) {
+        if(x >= workspace_dot_x[i] - 4 &&
+           x < workspace_dot_x[i] + WORKSPACE_DOT_SIZE + 4 &&
+           y >= workspace_dot_y - 4 &&
+           y < workspace_dot_y + WORKSPACE_DOT_SIZE + 4) {
+            mocha_workspace_switch(i);
+            return;
+        }
     }
-    ClientState *c;
-    Window w;
-    mocha_for_each_client(c, w) {
-        char *wm_class = get_wm_class(w);
-        if(wm_class) {
-            AppInfo *app = find_app_by_wmclass(wm_class);
-            if(app) {
-                for(int i = 0; i < num_dock_icons; i++) {
-                    if(dock_icons[i].app == app) {
-                        dock_icons[i].is_running = 1;
-                        break;
-                    }
-                }
+}
+
+/**
+ * Count a client appearing (delta 1) or going away (delta -1) against the
+ * dock icon of its app. Only an icon whose running state flips is marked
+ * dirty
+ */
+void mocha_dock_track_client(Client *c, int delta) {
+    if(delta > 0) {
+        AppInfo *app = find_app_by_class(c->wm_class);
+        c->dock_icon = -1;
+        for(int i = 0; app && i < num_dock_icons; i++) {
+            if(dock_icons[i].app == app) {
+                c->dock_icon = i;
+                break;
             }
-            free(wm_class);
         }
     }
-    mocha_for_each_client_end
-}
-
-static void rgba_to_cairo_argb32(uint8_t *data, int w, int h) {
-    for(int i = 0; i < w * h; ++i) {
-        uint8_t r = data[4 * i + 0];
-        uint8_t g = data[4 * i + 1];
-        uint8_t b = data[4 * i + 2];
-        uint8_t a = data[4 * i + 3];
-        r = (uint8_t)((r * a) / 255);
-        g = (uint8_t)((g * a) / 255);
-        b = (uint8_t)((b * a) / 255);
-        uint32_t argb =
-            ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
-        ((uint32_t *)data)[i] = argb;
+    if(c->dock_icon < 0) return;
+
+    DockIcon *icon = &dock_icons[c->dock_icon];
+    icon->running_count += delta;
+    bool running = icon->running_count > 0;
+    if(icon->is_running != running) {
+        icon->is_running = running;
+        icon->dirty = true;
     }
 }
 
-void mocha_draw_wallpaper(cairo_surface_t *surface, const char *filename,
-                          int width, int height) {
-    int img_w, img_h, img_channels;
-    mocha_log("Loading wallpaper: %s", filename);
-    stbi_uc *data = stbi_load(filename, &img_w, &img_h, &img_channels, 4);
-    if(!data) {
-        mocha_log("Failed to load wallpaper image: %s", filename);
-        cairo_t *cr = cairo_create(surface);
-        cairo_set_source_rgb(cr, 0, 0, 0);
-        cairo_paint(cr);
-        cairo_destroy(cr);
-        return;
-    }
-    mocha_log("Wallpaper loaded: %dx%d", img_w, img_h);
-    rgba_to_cairo_argb32(data, img_w, img_h);
-    cairo_surface_t *img_surface = cairo_image_surface_create_for_data(
-        data, CAIRO_FORMAT_ARGB32, img_w, img_h, img_w * 4);
-    if(cairo_surface_status(img_surface) != CAIRO_STATUS_SUCCESS) {
-        mocha_log("Failed to create Cairo surface for wallpaper");
-        stbi_image_free(data);
-        return;
+/**
+ * Match the dock icons to apps by WM class and recount their clients.
+ * Call whenever apps[] changes, the AppInfo pointers do not survive it
+ */
+void mocha_dock_bind_apps() {
+    for(int i = 0; i < num_dock_icons; i++) {
+        DockIcon *icon = &dock_icons[i];
+        AppInfo *app =
+            icon->wm_class[0] ? find_app_by_wmclass(icon->wm_class) : NULL;
+        if(icon->app != app) icon->dirty = true;
+        icon->app = app;
+        icon->running_count = 0;
     }
-    cairo_t *cr = cairo_create(surface);
-    const char *mode = config.colors.wallpaper_mode[0]
-                           ? config.colors.wallpaper_mode
-                           : "stretch_fit";
-    if(strcmp(mode, "stretch_fit") == 0) {
-        cairo_save(cr);
-        cairo_scale(cr, (double)width / img_w, (double)height / img_h);
-        cairo_set_source_surface(cr, img_surface, 0, 0);
-        cairo_paint(cr);
-        cairo_restore(cr);
-    } else {
-        double sx = (double)width / img_w;
-        double sy = (double)height / img_h;
-        double scale = sx < sy ? sx : sy;
-        double dx = (width - img_w * scale) / 2;
-        double dy = (height - img_h * scale) / 2;
-        cairo_save(cr);
-        cairo_translate(cr, dx, dy);
-        cairo_scale(cr, scale, scale);
-        cairo_set_source_surface(cr, img_surface, 0, 0);
-        cairo_paint(cr);
-        cairo_restore(cr);
+    for(Client *c = mocha_client_first(); c; c = mocha_client_next(c))
+        mocha_dock_track_client(c, 1);
+    for(int i = 0; i < num_dock_icons; i++) {
+        DockIcon *icon = &dock_icons[i];
+        if(icon->is_running && icon->running_count == 0) {
+            icon->is_running = false;
+            icon->dirty = true;
+        }
     }
-    cairo_destroy(cr);
-    cairo_surface_destroy(img_surface);
-    stbi_image_free(data);
+    if(dock_window != None) mocha_draw_dock(dock_window);
 }
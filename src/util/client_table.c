@@ -0,0 +1,213 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "util/client.h"
+
+/*
+ * Client registry. Records live in fixed-size chunks so pointers and slot
+ * indices stay valid while the registry grows. An open-addressing table
+ * with linear probing maps XIDs to slots; removal uses backward-shift
+ * deletion so lookups never wade through tombstones.
+ */
+
+#define CLIENT_CHUNK_BITS 8
+#define CLIENT_CHUNK_SIZE (1 << CLIENT_CHUNK_BITS)
+#define CLIENT_TABLE_MIN 64
+#define SLOT_EMPTY UINT32_MAX
+
+static Client **chunks = NULL;
+static int num_chunks = 0;
+static uint32_t num_slots = 0;
+static int free_slot = -1;
+
+static uint32_t *table = NULL;
+static uint32_t table_mask = 0;
+static int table_bits = 0;
+
+static int order_head = -1, order_tail = -1;
+
+int num_managed_clients = 0;
+
+static inline Client *slot_client(uint32_t slot) {
+    return &chunks[slot >> CLIENT_CHUNK_BITS][slot & (CLIENT_CHUNK_SIZE - 1)];
+}
+
+static inline uint32_t hash_xid(Window w) {
+    return (uint32_t)(((uint64_t)w * 0x9E3779B97F4A7C15ull) >>
+                      (64 - table_bits));
+}
+
+static int table_resize(int bits) {
+    uint32_t size = 1u << bits;
+    uint32_t *new_table = malloc(size * sizeof(*new_table));
+    if(!new_table) return -1;
+    memset(new_table, 0xff, size * sizeof(*new_table));
+
+    uint32_t *old_table = table;
+    uint32_t old_size = table ? table_mask + 1 : 0;
+    table = new_table;
+    table_mask = size - 1;
+    table_bits = bits;
+
+    for(uint32_t i = 0; i < old_size; i++) {
+        if(old_table[i] == SLOT_EMPTY) continue;
+        uint32_t pos = hash_xid(slot_client(old_table[i])->window);
+        while(table[pos] != SLOT_EMPTY) pos = (pos + 1) & table_mask;
+        table[pos] = old_table[i];
+    }
+    free(old_table);
+    return 0;
+}
+
+/* Returns the table position holding w, or -1 */
+static long table_find(Window w) {
+    if(!table) return -1;
+    uint32_t pos = hash_xid(w);
+    while(table[pos] != SLOT_EMPTY) {
+        if(slot_client(table[pos])->window == w) return pos;
+        pos = (pos + 1) & table_mask;
+    }
+    return -1;
+}
+
+static void table_delete(uint32_t pos) {
+    uint32_t hole = pos;
+    uint32_t next = (pos + 1) & table_mask;
+    while(table[next] != SLOT_EMPTY) {
+        uint32_t home = hash_xid(slot_client(table[next])->window);
+        /* Move the entry back if the hole lies between its home and it */
+        if(((next - home) & table_mask) >= ((next - hole) & table_mask)) {
+            table[hole] = table[next];
+            hole = next;
+        }
+        next = (next + 1) & table_mask;
+    }
+    table[hole] = SLOT_EMPTY;
+}
+
+static int alloc_slot() {
+    if(free_slot < 0) {
+        Client **new_chunks =
+            realloc(chunks, (num_chunks + 1) * sizeof(*new_chunks));
+        if(!new_chunks) return -1;
+        chunks = new_chunks;
+        Client *chunk = calloc(CLIENT_CHUNK_SIZE, sizeof(*chunk));
+        if(!chunk) return -1;
+        chunks[num_chunks++] = chunk;
+
+        /* Thread the new slots onto the free list, lowest first */
+        for(int i = CLIENT_CHUNK_SIZE - 1; i >= 0; i--) {
+            chunk[i].slot = num_slots + i;
+            chunk[i].next = free_slot;
+            free_slot = num_slots + i;
+        }
+        num_slots += CLIENT_CHUNK_SIZE;
+    }
+    int slot = free_slot;
+    free_slot = slot_client(slot)->next;
+    return slot;
+}
+
+/**
+ * Look up a managed client by window
+ */
+Client *mocha_client_find(Window w) {
+    long pos = table_find(w);
+    return pos < 0 ? NULL : slot_client(table[pos]);
+}
+
+/**
+ * Register a client, returns the existing record if w is already managed
+ */
+Client *mocha_client_add(Window w) {
+    Client *c = mocha_client_find(w);
+    if(c) return c;
+
+    /* Keep the load factor at or below 1/2 */
+    if(!table || (uint32_t)(num_managed_clients + 1) * 2 > table_mask + 1) {
+        int bits = table ? table_bits + 1 : 0;
+        while(!table && (1u << bits) < CLIENT_TABLE_MIN) bits++;
+        if(table_resize(bits) < 0) {
+            mocha_log("Client table: out of memory");
+            return NULL;
+        }
+    }
+
+    int slot = alloc_slot();
+    if(slot < 0) {
+        mocha_log("Client table: out of memory");
+        return NULL;
+    }
+    c = slot_client(slot);
+    uint32_t generation = c->generation;
+    memset(c, 0, sizeof(*c));
+    c->window = w;
+    c->slot = slot;
+    c->generation = generation;
+
+    c->prev = order_tail;
+    c->next = -1;
+    if(order_tail >= 0)
+        slot_client(order_tail)->next = slot;
+    else
+        order_head = slot;
+    order_tail = slot;
+
+    uint32_t pos = hash_xid(w);
+    while(table[pos] != SLOT_EMPTY) pos = (pos + 1) & table_mask;
+    table[pos] = slot;
+    num_managed_clients++;
+    return c;
+}
+
+/**
+ * Unregister a client, its handles go stale
+ */
+void mocha_client_remove(Window w) {
+    long pos = table_find(w);
+    if(pos < 0) return;
+    uint32_t slot = table[pos];
+    Client *c = slot_client(slot);
+    table_delete(pos);
+
+    if(c->prev >= 0)
+        slot_client(c->prev)->next = c->next;
+    else
+        order_head = c->next;
+    if(c->next >= 0)
+        slot_client(c->next)->prev = c->prev;
+    else
+        order_tail = c->prev;
+
+    c->window = None;
+    c->generation++;
+    c->prev = -1;
+    c->next = free_slot;
+    free_slot = slot;
+    num_managed_clients--;
+}
+
+Client *mocha_client_first() {
+    return order_head >= 0 ? slot_client(order_head) : NULL;
+}
+
+Client *mocha_client_next(Client *c) {
+    return c->next >= 0 ? slot_client(c->next) : NULL;
+}
+
+ClientHandle mocha_client_handle(const Client *c) {
+    ClientHandle h = {c->slot, c->generation};
+    return h;
+}
+
+/**
+ * Resolve a handle, NULL if its client has been unmanaged since
+ */
+Client *mocha_client_from_handle(ClientHandle h) {
+    if(h.slot >= num_slots) return NULL;
+    Client *c = slot_client(h.slot);
+    if(c->generation != h.generation || c->window == None) return NULL;
+    return c;
+}
@@ -92,6 +92,20 @@ int parse_config(const char *filename, struct Config *cfg) {
                     cfg->features.quotes_enabled = atoi(v);
                 else if(strcmp(k, "border_radius") == 0)
                     cfg->features.border_radius = atoi(v);
+                else if(strcmp(k, "debug_roundtrips") == 0)
+                    cfg->features.debug_roundtrips = atoi(v);
+                else if(strcmp(k, "debug_geometry") == 0)
+                    cfg->features.debug_geometry = atoi(v);
+                else if(strcmp(k, "volume_backend") == 0)
+                    strncpy(cfg->features.volume_backend, v, 31);
+                else if(strcmp(k, "layout") == 0)
+                    strncpy(cfg->features.layout, v, 31);
+                else if(strcmp(k, "workspaces") == 0)
+                    cfg->features.workspaces = atoi(v);
+                else if(strcmp(k, "icon_theme") == 0)
+                    strncpy(cfg->features.icon_theme, v, 63);
+                else if(strcmp(k, "icon_cache_kb") == 0)
+                    cfg->features.icon_cache_kb = atoi(v);
                 else if(strcmp(k, "wallpaper") == 0)
                     strncpy(cfg->colors.wallpaper, v, MAX_PATH_LEN);
             }
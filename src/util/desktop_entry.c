@@ -0,0 +1,253 @@
+#include "util/desktop_entry.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Files up to this size are read rather than mapped */
+#define DESKTOP_ENTRY_READ_SIZE 16384
+
+/*
+ * .desktop parser. Files are walked a line at a time with memchr, values
+ * are kept as spans into the file data and only copied (and unescaped) by
+ * the caller. Only the [Desktop Entry] group is read, keys
+ * in [Desktop Action ...] groups never leak into it.
+ */
+
+/* Message locale, lang_COUNTRY.ENCODING@MODIFIER */
+static struct {
+    char lang[16];
+    char country[16];
+    char modifier[32];
+} locale;
+static pthread_once_t locale_once = PTHREAD_ONCE_INIT;
+
+static void copy_part(char *dst, size_t size, const char *src, size_t len) {
+    if(len >= size) len = size - 1;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void load_locale() {
+    const char *env = getenv("LC_ALL");
+    if(!env || !env[0]) env = getenv("LC_MESSAGES");
+    if(!env || !env[0]) env = getenv("LANG");
+    if(!env || strcmp(env, "C") == 0 || strcmp(env, "POSIX") == 0) return;
+
+    size_t n = strcspn(env, "_.@");
+    copy_part(locale.lang, sizeof(locale.lang), env, n);
+    env += n;
+    if(*env == '_') {
+        n = strcspn(++env, ".@");
+        copy_part(locale.country, sizeof(locale.country), env, n);
+        env += n;
+    }
+    if(*env == '.') env += strcspn(env, "@");
+    if(*env == '@') {
+        env++;
+        copy_part(locale.modifier, sizeof(locale.modifier), env, strlen(env));
+    }
+}
+
+static bool span_is(const char *s, size_t len, const char *lit) {
+    return strlen(lit) == len && memcmp(s, lit, len) == 0;
+}
+
+/**
+ * How well a key locale like de_AT@euro matches ours, following the spec's
+ * lang_COUNTRY@MODIFIER > lang_COUNTRY > lang@MODIFIER > lang order. 0 if
+ * it does not apply
+ */
+static int locale_score(const char *loc, size_t len) {
+    if(!locale.lang[0]) return 0;
+    const char *end = loc + len;
+    const char *at = memchr(loc, '@', len);
+    const char *us = memchr(loc, '_', (at ? at : end) - loc);
+    const char *lang_end = us ? us : at ? at : end;
+
+    if(!span_is(loc, lang_end - loc, locale.lang)) return 0;
+    int score = 1;
+    if(us) {
+        const char *country_end = at ? at : end;
+        if(!span_is(us + 1, country_end - us - 1, locale.country)) return 0;
+        score += 2;
+    }
+    if(at) {
+        if(!span_is(at + 1, end - at - 1, locale.modifier)) return 0;
+        score += 1;
+    }
+    return score;
+}
+
+static bool value_true(DesktopValue v) { return span_is(v.ptr, v.len, "true"); }
+
+/**
+ * Parse the [Desktop Entry] group out of a .desktop file's contents
+ */
+void mocha_desktop_entry_parse(const char *data, size_t len,
+                               DesktopEntry *entry) {
+    pthread_once(&locale_once, load_locale);
+
+    entry->name = entry->exec = entry->icon = entry->wm_class =
+        (DesktopValue){NULL, 0};
+    entry->no_display = false;
+    entry->hidden = false;
+    entry->is_application = true;
+
+    int name_score = -1;
+    bool in_entry = false;
+    const char *p = data, *end = data + len;
+    while(p < end) {
+        const char *line = p;
+        const char *line_end = memchr(p, '\n', end - p);
+        if(!line_end) line_end = end;
+        p = line_end + 1;
+
+        while(line < line_end && (*line == ' ' || *line == '\t')) line++;
+        while(line_end > line &&
+              (line_end[-1] == '\r' || line_end[-1] == ' ' ||
+               line_end[-1] == '\t'))
+            line_end--;
+        if(line == line_end || *line == '#') continue;
+
+        if(*line == '[') {
+            in_entry = span_is(line, line_end - line, "[Desktop Entry]");
+            continue;
+        }
+        if(!in_entry) continue;
+
+        const char *eq = memchr(line, '=', line_end - line);
+        if(!eq) continue;
+        const char *key_end = eq;
+        while(key_end > line && (key_end[-1] == ' ' || key_end[-1] == '\t'))
+            key_end--;
+        const char *value = eq + 1;
+        while(value < line_end && (*value == ' ' || *value == '\t')) value++;
+        DesktopValue v = {value, line_end - value};
+
+        /* Split Key[locale] */
+        const char *loc = memchr(line, '[', key_end - line);
+        size_t key_len = (loc ? loc : key_end) - line;
+        if(loc) {
+            if(key_end[-1] != ']') continue;
+            if(!span_is(line, key_len, "Name")) continue;
+            int score = locale_score(loc + 1, key_end - loc - 2);
+            if(score > 0 && score > name_score) {
+                entry->name = v;
+                name_score = score;
+            }
+            continue;
+        }
+
+        if(span_is(line, key_len, "Name")) {
+            if(name_score < 0) {
+                entry->name = v;
+                name_score = 0;
+            }
+        } else if(span_is(line, key_len, "Exec")) {
+            entry->exec = v;
+        } else if(span_is(line, key_len, "Icon")) {
+            entry->icon = v;
+        } else if(span_is(line, key_len, "StartupWMClass")) {
+            entry->wm_class = v;
+        } else if(span_is(line, key_len, "NoDisplay")) {
+            entry->no_display = value_true(v);
+        } else if(span_is(line, key_len, "Hidden")) {
+            entry->hidden = value_true(v);
+        } else if(span_is(line, key_len, "Type")) {
+            entry->is_application = span_is(v.ptr, v.len, "Application");
+        }
+    }
+}
+
+/**
+ * Read and parse a .desktop file, false if it cannot be read. Typical
+ * files fit in one read into a reused buffer, mapping them costs more
+ * than the copy, so only larger ones are mapped. The buffer is per thread,
+ * so app directories can be scanned in parallel
+ */
+bool mocha_desktop_entry_open(const char *path, DesktopEntry *entry) {
+    static _Thread_local char buf[DESKTOP_ENTRY_READ_SIZE];
+    memset(entry, 0, sizeof(*entry));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if(n < 0) {
+        close(fd);
+        return false;
+    }
+    if((size_t)n < sizeof(buf)) {
+        close(fd);
+        mocha_desktop_entry_parse(buf, n, entry);
+        return true;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return false;
+
+    entry->map = map;
+    entry->map_size = st.st_size;
+    mocha_desktop_entry_parse(map, st.st_size, entry);
+    return true;
+}
+
+void mocha_desktop_entry_close(DesktopEntry *entry) {
+    if(entry->map) munmap(entry->map, entry->map_size);
+    entry->map = NULL;
+    entry->map_size = 0;
+}
+
+/**
+ * Unescape a value into out, which must hold value.len + 1 bytes. For
+ * Exec, field codes such as %U are dropped and %% becomes %. Returns the
+ * length written
+ */
+size_t mocha_desktop_value_unescape(DesktopValue value, bool exec,
+                                    char *out) {
+    size_t n = 0;
+    for(size_t i = 0; i < value.len; i++) {
+        char c = value.ptr[i];
+        if(c == '\\' && i + 1 < value.len) {
+            switch(value.ptr[++i]) {
+                case 's':
+                    c = ' ';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case '\\':
+                    c = '\\';
+                    break;
+                default:
+                    /* Not a string escape, Exec quoting handles it */
+                    out[n++] = '\\';
+                    c = value.ptr[i];
+                    break;
+            }
+        } else if(exec && c == '%' && i + 1 < value.len) {
+            if(value.ptr[++i] != '%') continue;
+        }
+        out[n++] = c;
+    }
+    /* Dropped field codes can leave trailing blanks */
+    while(exec && n > 0 && out[n - 1] == ' ') n--;
+    out[n] = '\0';
+    return n;
+}
@@ -0,0 +1,394 @@
+#include "util/icon_cache.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "lib/stb_image.h"
+#include "main.h"
+#include "util/pixel.h"
+
+/*
+ * Decoded icons keyed by (file, pixel size), so the dock and the launcher
+ * each get theirs at the right scale and apps sharing an icon share the
+ * surface. Entries sit on an LRU list and the least recently used ones
+ * are dropped once the surfaces exceed the byte budget. Files that fail
+ * to decode are remembered too, so they are not retried on every paint.
+ *
+ * Decodes can also run on a small worker pool. A requested icon gets a
+ * pending entry right away, the job goes on a queue, and finished jobs
+ * are handed back through an eventfd for the main thread to collect.
+ * Workers never touch the cache itself.
+ */
+
+#define ICON_CACHE_BUCKETS 256
+#define ICON_DECODERS_MAX 4
+
+typedef struct IconEntry {
+    char *path;
+    int size;
+    uint32_t hash;
+    /* Premultiplied ARGB32, NULL if the file could not be decoded */
+    cairo_surface_t *surface;
+    /* Being decoded by a worker, surface is not there yet */
+    bool pending;
+    size_t bytes;
+    /* LRU order, most recently used first */
+    struct IconEntry *prev, *next;
+    /* Next entry in the same bucket */
+    struct IconEntry *chain;
+} IconEntry;
+
+static IconEntry *buckets[ICON_CACHE_BUCKETS];
+static IconEntry *lru_head, *lru_tail;
+static size_t cache_bytes = 0;
+static size_t cache_budget = ICON_CACHE_DEFAULT_BUDGET;
+
+/* One decode for the worker pool, owned by whichever list it is on */
+typedef struct IconJob {
+    char *path;
+    int size;
+    cairo_surface_t *surface;
+    struct IconJob *next;
+} IconJob;
+
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_wake = PTHREAD_COND_INITIALIZER;
+/* Queued and finished jobs, protected by job_lock */
+static IconJob *queue_head, *queue_tail;
+static IconJob *done_head;
+static int done_fd = -1;
+static int num_decoders = 0;
+
+static uint32_t hash_key(const char *path, int size) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash ^ (uint32_t)size * 2654435761u;
+}
+
+static void lru_unlink(IconEntry *e) {
+    if(e->prev)
+        e->prev->next = e->next;
+    else
+        lru_head = e->next;
+    if(e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push(IconEntry *e) {
+    e->prev = NULL;
+    e->next = lru_head;
+    if(lru_head)
+        lru_head->prev = e;
+    else
+        lru_tail = e;
+    lru_head = e;
+}
+
+static void remove_entry(IconEntry *e) {
+    IconEntry **link = &buckets[e->hash % ICON_CACHE_BUCKETS];
+    while(*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    lru_unlink(e);
+    cache_bytes -= e->bytes;
+    if(e->surface) cairo_surface_destroy(e->surface);
+    free(e->path);
+    free(e);
+}
+
+/**
+ * Evict least recently used entries until the cache fits its budget,
+ * keep is never evicted
+ */
+static void enforce_budget(const IconEntry *keep) {
+    while(cache_bytes > cache_budget && lru_tail && lru_tail != keep)
+        remove_entry(lru_tail);
+}
+
+static cairo_surface_t *decode_icon(const char *path, int size) {
+    int w, h, n;
+    unsigned char *data = stbi_load(path, &w, &h, &n, 4);
+    if(!data) return NULL;
+
+    mocha_pixel_rgba_to_argb32(data, (size_t)w * h);
+    cairo_surface_t *full = cairo_image_surface_create_for_data(
+        data, CAIRO_FORMAT_ARGB32, w, h, w * 4);
+
+    cairo_surface_t *icon =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    cairo_t *cr = cairo_create(icon);
+    cairo_scale(cr, (double)size / w, (double)size / h);
+    cairo_set_source_surface(cr, full, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    cairo_surface_destroy(full);
+    stbi_image_free(data);
+    if(cairo_surface_status(icon) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(icon);
+        return NULL;
+    }
+    return icon;
+}
+
+/**
+ * Set the byte budget for decoded icons, evicting as needed
+ */
+void mocha_icon_cache_set_budget(size_t bytes) {
+    cache_budget = bytes;
+    enforce_budget(NULL);
+}
+
+static IconEntry *find_entry(const char *path, int size, uint32_t hash) {
+    for(IconEntry *e = buckets[hash % ICON_CACHE_BUCKETS]; e; e = e->chain)
+        if(e->hash == hash && e->size == size && strcmp(e->path, path) == 0)
+            return e;
+    return NULL;
+}
+
+static IconEntry *add_entry(const char *path, int size, uint32_t hash) {
+    IconEntry *e = calloc(1, sizeof(*e));
+    if(!e || !(e->path = strdup(path))) {
+        free(e);
+        return NULL;
+    }
+    e->size = size;
+    e->hash = hash;
+    e->bytes = sizeof(*e);
+    IconEntry **bucket = &buckets[hash % ICON_CACHE_BUCKETS];
+    e->chain = *bucket;
+    *bucket = e;
+    lru_push(e);
+    cache_bytes += e->bytes;
+    return e;
+}
+
+/* Account for a surface that has just arrived in an entry */
+static void fill_entry(IconEntry *e, cairo_surface_t *surface) {
+    e->surface = surface;
+    e->pending = false;
+    if(surface) {
+        size_t bytes =
+            (size_t)cairo_image_surface_get_stride(surface) * e->size;
+        e->bytes += bytes;
+        cache_bytes += bytes;
+    }
+    enforce_budget(e);
+}
+
+/**
+ * Forget the queued decode of one icon, if a worker has not taken it yet
+ */
+static void cancel_job(const char *path, int size) {
+    pthread_mutex_lock(&job_lock);
+    IconJob *prev = NULL;
+    for(IconJob *job = queue_head; job; prev = job, job = job->next) {
+        if(job->size != size || strcmp(job->path, path) != 0) continue;
+        if(prev)
+            prev->next = job->next;
+        else
+            queue_head = job->next;
+        if(queue_tail == job) queue_tail = prev;
+        free(job->path);
+        free(job);
+        break;
+    }
+    pthread_mutex_unlock(&job_lock);
+}
+
+/**
+ * Icon file decoded and scaled to size x size, NULL if it cannot be read.
+ * The surface belongs to the cache and is only valid until the next call
+ */
+cairo_surface_t *mocha_icon_cache_get(const char *path, int size) {
+    bool pending;
+    cairo_surface_t *surface = mocha_icon_cache_request(path, size, &pending);
+    if(!pending) return surface;
+
+    /* Queued for a worker, decode it here rather than wait. A worker that
+       already took the job finishes it and the result is dropped */
+    IconEntry *e = find_entry(path, size, hash_key(path, size));
+    cancel_job(path, size);
+    fill_entry(e, decode_icon(path, size));
+    return e->surface;
+}
+
+static void *decoder_thread(void *arg) {
+    for(;;) {
+        pthread_mutex_lock(&job_lock);
+        while(!queue_head) pthread_cond_wait(&job_wake, &job_lock);
+        IconJob *job = queue_head;
+        queue_head = job->next;
+        if(!queue_head) queue_tail = NULL;
+        pthread_mutex_unlock(&job_lock);
+
+        job->surface = decode_icon(job->path, job->size);
+
+        pthread_mutex_lock(&job_lock);
+        job->next = done_head;
+        done_head = job;
+        pthread_mutex_unlock(&job_lock);
+
+        uint64_t one = 1;
+        if(write(done_fd, &one, sizeof(one)) < 0) perror("icon decoder write");
+    }
+    return NULL;
+}
+
+/**
+ * Start the decoder pool if needed, returns an eventfd that becomes
+ * readable when decoded icons are ready for mocha_icon_cache_collect(),
+ * or -1 if icons are decoded inline
+ */
+int mocha_icon_cache_async_fd() {
+    if(done_fd >= 0 || num_decoders < 0) return done_fd;
+    done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(done_fd < 0) {
+        perror("eventfd");
+        num_decoders = -1;
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int wanted = cpus < 1 ? 1 : cpus > ICON_DECODERS_MAX ? ICON_DECODERS_MAX
+                                                          : cpus;
+    for(int i = 0; i < wanted; i++) {
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, decoder_thread, NULL) != 0) break;
+        pthread_detach(thread);
+        num_decoders++;
+    }
+    if(num_decoders == 0) {
+        mocha_log("Icon cache: no decoder threads, decoding inline");
+        close(done_fd);
+        done_fd = -1;
+        num_decoders = -1;
+    }
+    return done_fd;
+}
+
+/**
+ * Like mocha_icon_cache_get(), but a miss is queued on the decoder pool
+ * instead of blocking. Returns NULL with *pending set until the icon
+ * arrives through mocha_icon_cache_collect(). Without the pool this is
+ * mocha_icon_cache_get()
+ */
+cairo_surface_t *mocha_icon_cache_request(const char *path, int size,
+                                          bool *pending) {
+    *pending = false;
+    if(!path || !path[0] || size <= 0) return NULL;
+    uint32_t hash = hash_key(path, size);
+    IconEntry *e = find_entry(path, size, hash);
+    if(e) {
+        lru_unlink(e);
+        lru_push(e);
+        *pending = e->pending;
+        return e->surface;
+    }
+
+    e = add_entry(path, size, hash);
+    if(!e) return NULL;
+    IconJob *job = num_decoders > 0 ? calloc(1, sizeof(*job)) : NULL;
+    if(!job || !(job->path = strdup(path))) {
+        free(job);
+        fill_entry(e, decode_icon(path, size));
+        return e->surface;
+    }
+
+    e->pending = true;
+    *pending = true;
+    job->size = size;
+    pthread_mutex_lock(&job_lock);
+    if(queue_tail)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&job_wake);
+    pthread_mutex_unlock(&job_lock);
+    return NULL;
+}
+
+/**
+ * Move finished decodes into the cache, returns how many icons arrived.
+ * Results whose entry was evicted in the meantime are dropped
+ */
+int mocha_icon_cache_collect() {
+    if(done_fd < 0) return 0;
+    uint64_t count;
+    if(read(done_fd, &count, sizeof(count)) < 0) count = 0;
+
+    pthread_mutex_lock(&job_lock);
+    IconJob *jobs = done_head;
+    done_head = NULL;
+    pthread_mutex_unlock(&job_lock);
+
+    int arrived = 0;
+    while(jobs) {
+        IconJob *job = jobs;
+        jobs = job->next;
+        IconEntry *e =
+            find_entry(job->path, job->size, hash_key(job->path, job->size));
+        if(e && e->pending) {
+            fill_entry(e, job->surface);
+            arrived++;
+        } else if(job->surface) {
+            cairo_surface_destroy(job->surface);
+        }
+        free(job->path);
+        free(job);
+    }
+    return arrived;
+}
+
+/**
+ * Forget queued decodes of one size, or of every size if size is 0.
+ * Jobs already running finish and are dropped when collected
+ */
+static void cancel_jobs(int size) {
+    pthread_mutex_lock(&job_lock);
+    IconJob **link = &queue_head;
+    queue_tail = NULL;
+    while(*link) {
+        IconJob *job = *link;
+        if(size && job->size != size) {
+            queue_tail = job;
+            link = &job->next;
+            continue;
+        }
+        *link = job->next;
+        free(job->path);
+        free(job);
+    }
+    pthread_mutex_unlock(&job_lock);
+}
+
+/**
+ * Drop every icon of one size, for callers whose icons are only needed
+ * while they are on screen
+ */
+void mocha_icon_cache_drop_size(int size) {
+    cancel_jobs(size);
+    for(IconEntry *e = lru_head, *next; e; e = next) {
+        next = e->next;
+        if(e->size == size) remove_entry(e);
+    }
+}
+
+/**
+ * Drop everything, icon files may have changed
+ */
+void mocha_icon_cache_clear() {
+    cancel_jobs(0);
+    while(lru_head) remove_entry(lru_head);
+}
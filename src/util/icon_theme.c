@@ -0,0 +1,704 @@
+#include "util/icon_theme.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+
+/*
+ * Icon lookup following the freedesktop icon theme spec, PNG only since
+ * that is all the icon loader decodes. The theme chain (the configured
+ * theme, the themes it inherits, then hicolor) is resolved from the
+ * index.theme files, and every icon in it is indexed once, from
+ * icon-theme.cache where that is up to date and by listing the size
+ * directories otherwise. A lookup is then a hash probe plus a walk over
+ * the images of one name, without touching the filesystem.
+ */
+
+#define MAX_THEMES 8
+#define MAX_ICON_BASES 8
+#define MAX_THEME_ROOTS (MAX_THEMES * MAX_ICON_BASES)
+#define ICON_ARENA_BLOCK 65536
+/* Unthemed icons, searched after every theme */
+#define ICON_PIXMAPS "/usr/share/pixmaps"
+
+/* icon-theme.cache image flag for a .png file */
+#define CACHE_HAS_PNG 4
+
+typedef enum {
+    ICON_DIR_FIXED,
+    ICON_DIR_SCALABLE,
+    ICON_DIR_THRESHOLD
+} IconDirType;
+
+/* One size directory of a theme, e.g. /usr/share/icons/hicolor/48x48/apps */
+typedef struct {
+    char *path;
+    /* Directory name inside the theme, points into path */
+    const char *subdir;
+    /* Position in the theme chain, unthemed icons come after all themes */
+    int theme;
+    IconDirType type;
+    int size, min_size, max_size, threshold;
+} IconDir;
+
+/* A theme inside one base directory, e.g. /usr/share/icons/hicolor. Its
+   size directories are dirs[first_dir .. first_dir + num_dirs) */
+typedef struct {
+    char *path;
+    uint32_t first_dir, num_dirs;
+} ThemeRoot;
+
+/* One icon file, chained per name */
+typedef struct {
+    uint32_t dir;
+    /* Next image of the same name plus one, 0 ends the chain */
+    uint32_t next;
+} IconImage;
+
+typedef struct {
+    const char *name;
+    uint32_t len;
+    /* First image plus one */
+    uint32_t first;
+} IconName;
+
+/* A [size directory] group of an index.theme file */
+typedef struct {
+    const char *name;
+    size_t name_len;
+    IconDirType type;
+    int size, min_size, max_size, threshold, scale;
+} ThemeSection;
+
+static char theme_name[64] = "hicolor";
+static char themes[MAX_THEMES][64];
+static int num_themes = 0;
+static char bases[MAX_ICON_BASES][1024];
+static int num_bases = 0;
+static ThemeRoot roots[MAX_THEME_ROOTS];
+static int num_roots = 0;
+static uint32_t theme_stamp = 2166136261u;
+static pthread_once_t themes_once = PTHREAD_ONCE_INIT;
+static pthread_once_t index_once = PTHREAD_ONCE_INIT;
+
+static IconDir *dirs;
+static uint32_t num_dirs, dirs_cap;
+static int pixmaps_dir = -1;
+static IconImage *images;
+static uint32_t num_images, images_cap;
+static IconName *names;
+static uint32_t names_mask, names_used;
+
+/* Names and paths live as long as the process, so they are never freed */
+static char *arena;
+static size_t arena_left;
+
+static char *arena_copy(const char *s, size_t len) {
+    if(len + 1 > arena_left) {
+        size_t size = len + 1 > ICON_ARENA_BLOCK ? len + 1 : ICON_ARENA_BLOCK;
+        arena = malloc(size);
+        arena_left = arena ? size : 0;
+        if(!arena) return NULL;
+    }
+    char *copy = arena;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    arena += len + 1;
+    arena_left -= len + 1;
+    return copy;
+}
+
+static bool grow(void **array, uint32_t *cap, uint32_t count, size_t size) {
+    if(count < *cap) return true;
+    uint32_t new_cap = *cap ? *cap * 2 : 64;
+    void *grown = realloc(*array, new_cap * size);
+    if(!grown) return false;
+    *array = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static bool span_is(const char *s, size_t len, const char *lit) {
+    return strlen(lit) == len && memcmp(s, lit, len) == 0;
+}
+
+static int span_int(const char *s, size_t len) {
+    char buf[16];
+    if(len >= sizeof(buf)) len = sizeof(buf) - 1;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    return atoi(buf);
+}
+
+/**
+ * Next item of a separated list, trimmed. Returns false at the end
+ */
+static bool next_item(const char **list, const char *end, char sep,
+                      const char **item, size_t *len) {
+    while(*list < end) {
+        const char *start = *list;
+        const char *stop = memchr(start, sep, end - start);
+        if(!stop) stop = end;
+        *list = stop + 1;
+        while(start < stop && *start == ' ') start++;
+        while(stop > start && stop[-1] == ' ') stop--;
+        if(stop == start) continue;
+        *item = start;
+        *len = stop - start;
+        return true;
+    }
+    return false;
+}
+
+static uint32_t hash_bytes(uint32_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void stamp_mtime(const struct stat *st) {
+    int64_t mtime =
+        (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+    theme_stamp = hash_bytes(theme_stamp, &mtime, sizeof(mtime));
+}
+
+static char *read_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return NULL;
+    struct stat st;
+    char *data = NULL;
+    if(fstat(fd, &st) == 0 && st.st_size > 0 && (data = malloc(st.st_size))) {
+        if(read(fd, data, st.st_size) != st.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *len = st.st_size;
+    }
+    close(fd);
+    return data;
+}
+
+static void add_base(const char *dir, size_t len, const char *suffix) {
+    if(!len || num_bases >= MAX_ICON_BASES) return;
+    char *base = bases[num_bases];
+    snprintf(base, sizeof(bases[0]), "%.*s%s", (int)len, dir, suffix);
+    for(int i = 0; i < num_bases; i++)
+        if(strcmp(bases[i], base) == 0) return;
+    num_bases++;
+}
+
+/**
+ * Icon base directories in spec order: ~/.icons, then the icons
+ * directory of every XDG data directory
+ */
+static void resolve_bases() {
+    const char *home = getenv("HOME");
+    const char *data_home = getenv("XDG_DATA_HOME");
+    const char *data_dirs = getenv("XDG_DATA_DIRS");
+
+    if(home && home[0]) add_base(home, strlen(home), "/.icons");
+    if(data_home && data_home[0] == '/')
+        add_base(data_home, strlen(data_home), "/icons");
+    else if(home && home[0])
+        add_base(home, strlen(home), "/.local/share/icons");
+
+    if(!data_dirs || !data_dirs[0]) data_dirs = "/usr/local/share:/usr/share";
+    const char *list = data_dirs, *item;
+    size_t len;
+    while(next_item(&list, data_dirs + strlen(data_dirs), ':', &item, &len))
+        add_base(item, len, "/icons");
+}
+
+static void add_dir(int theme, const ThemeRoot *root,
+                    const ThemeSection *s) {
+    if(!grow((void **)&dirs, &dirs_cap, num_dirs, sizeof(*dirs))) return;
+    size_t root_len = strlen(root->path);
+    char path[2048];
+    int len = snprintf(path, sizeof(path), "%s/%.*s", root->path,
+                       (int)s->name_len, s->name);
+    if(len >= (int)sizeof(path)) return;
+
+    IconDir *d = &dirs[num_dirs];
+    d->path = arena_copy(path, len);
+    if(!d->path) return;
+    d->subdir = d->path + root_len + 1;
+    d->theme = theme;
+    d->type = s->type;
+    d->size = s->size;
+    d->min_size = s->min_size >= 0 ? s->min_size : s->size;
+    d->max_size = s->max_size >= 0 ? s->max_size : s->size;
+    d->threshold = s->threshold;
+    num_dirs++;
+}
+
+/**
+ * Start a root for a theme in a base directory, NULL if the theme is not
+ * installed there. The caller adds its size directories
+ */
+static ThemeRoot *add_root(int theme, int base) {
+    char path[1100];
+    struct stat st;
+    if(num_roots >= MAX_THEME_ROOTS) return NULL;
+    snprintf(path, sizeof(path), "%s/%s", bases[base], themes[theme]);
+    if(stat(path, &st) < 0 || !S_ISDIR(st.st_mode)) return NULL;
+    stamp_mtime(&st);
+
+    ThemeRoot *root = &roots[num_roots];
+    root->path = arena_copy(path, strlen(path));
+    if(!root->path) return NULL;
+    root->first_dir = num_dirs;
+    root->num_dirs = 0;
+    num_roots++;
+    return root;
+}
+
+/**
+ * Read an index.theme file. Adds the theme's size directories for every
+ * base directory the theme is installed in and returns its Inherits list
+ */
+static void parse_index_theme(int theme, const char *data, size_t len,
+                              const char **inherits, size_t *inherits_len) {
+    ThemeSection *sections = NULL;
+    uint32_t num_sections = 0, sections_cap = 0;
+    const char *directories = NULL;
+    size_t directories_len = 0;
+    bool in_theme = false;
+    int current = -1;
+
+    const char *p = data, *end = data + len;
+    while(p < end) {
+        const char *line = p;
+        const char *line_end = memchr(p, '\n', end - p);
+        if(!line_end) line_end = end;
+        p = line_end + 1;
+
+        while(line < line_end && (*line == ' ' || *line == '\t')) line++;
+        while(line_end > line && (line_end[-1] == '\r' ||
+                                  line_end[-1] == ' ' || line_end[-1] == '\t'))
+            line_end--;
+        if(line == line_end || *line == '#') continue;
+
+        if(*line == '[') {
+            const char *name = line + 1;
+            size_t name_len = line_end - name - (line_end[-1] == ']');
+            in_theme = span_is(name, name_len, "Icon Theme");
+            current = -1;
+            if(in_theme || !grow((void **)&sections, &sections_cap,
+                                 num_sections, sizeof(*sections)))
+                continue;
+            current = num_sections++;
+            sections[current] = (ThemeSection){
+                name, name_len, ICON_DIR_THRESHOLD, 0, -1, -1, 2, 1};
+            continue;
+        }
+
+        const char *eq = memchr(line, '=', line_end - line);
+        if(!eq) continue;
+        const char *key_end = eq;
+        while(key_end > line && key_end[-1] == ' ') key_end--;
+        const char *value = eq + 1;
+        while(value < line_end && *value == ' ') value++;
+        size_t key_len = key_end - line, value_len = line_end - value;
+
+        if(in_theme) {
+            if(span_is(line, key_len, "Directories")) {
+                directories = value;
+                directories_len = value_len;
+            } else if(span_is(line, key_len, "Inherits")) {
+                *inherits = value;
+                *inherits_len = value_len;
+            }
+            continue;
+        }
+        if(current < 0) continue;
+        ThemeSection *s = &sections[current];
+        if(span_is(line, key_len, "Size")) {
+            s->size = span_int(value, value_len);
+        } else if(span_is(line, key_len, "MinSize")) {
+            s->min_size = span_int(value, value_len);
+        } else if(span_is(line, key_len, "MaxSize")) {
+            s->max_size = span_int(value, value_len);
+        } else if(span_is(line, key_len, "Threshold")) {
+            s->threshold = span_int(value, value_len);
+        } else if(span_is(line, key_len, "Scale")) {
+            s->scale = span_int(value, value_len);
+        } else if(span_is(line, key_len, "Type")) {
+            if(span_is(value, value_len, "Fixed"))
+                s->type = ICON_DIR_FIXED;
+            else if(span_is(value, value_len, "Scalable"))
+                s->type = ICON_DIR_SCALABLE;
+        }
+    }
+
+    for(int b = 0; b < num_bases; b++) {
+        ThemeRoot *root = add_root(theme, b);
+        if(!root) continue;
+        const char *list = directories, *item;
+        size_t item_len;
+        while(directories &&
+              next_item(&list, directories + directories_len, ',', &item,
+                        &item_len)) {
+            for(uint32_t i = 0; i < num_sections; i++) {
+                const ThemeSection *s = &sections[i];
+                if(s->name_len != item_len ||
+                   memcmp(s->name, item, item_len) != 0)
+                    continue;
+                /* HiDPI copies are of no use at scale 1 */
+                if(s->size > 0 && s->scale == 1) add_dir(theme, root, s);
+                break;
+            }
+        }
+        root->num_dirs = num_dirs - root->first_dir;
+    }
+    free(sections);
+}
+
+/**
+ * Size directories of a theme without an index.theme, going by the usual
+ * NxN/context naming. Minimal installs often ship hicolor like this
+ */
+static void guess_theme_dirs(int theme) {
+    for(int b = 0; b < num_bases; b++) {
+        ThemeRoot *root = add_root(theme, b);
+        if(!root) continue;
+        DIR *d = opendir(root->path);
+        if(!d) continue;
+        struct dirent *size_entry;
+        while((size_entry = readdir(d)) != NULL) {
+            int w, h, end = 0;
+            if(sscanf(size_entry->d_name, "%dx%d%n", &w, &h, &end) != 2 ||
+               size_entry->d_name[end] || w != h || w <= 0)
+                continue;
+            char path[2048];
+            snprintf(path, sizeof(path), "%s/%s", root->path,
+                     size_entry->d_name);
+            DIR *sub = opendir(path);
+            if(!sub) continue;
+            struct dirent *context;
+            while((context = readdir(sub)) != NULL) {
+                if(context->d_name[0] == '.') continue;
+                char name[512];
+                int len = snprintf(name, sizeof(name), "%s/%s",
+                                   size_entry->d_name, context->d_name);
+                if(len >= (int)sizeof(name)) continue;
+                ThemeSection s = {name, len, ICON_DIR_FIXED, w, -1, -1, 2, 1};
+                add_dir(theme, root, &s);
+            }
+            closedir(sub);
+        }
+        closedir(d);
+        root->num_dirs = num_dirs - root->first_dir;
+    }
+}
+
+static void add_theme(const char *name, size_t len) {
+    if(!len || len >= sizeof(themes[0]) || num_themes >= MAX_THEMES) return;
+    for(int i = 0; i < num_themes; i++)
+        if(span_is(name, len, themes[i])) return;
+    int theme = num_themes++;
+    memcpy(themes[theme], name, len);
+    themes[theme][len] = '\0';
+    theme_stamp = hash_bytes(theme_stamp, name, len + 1);
+
+    /* The first index.theme found describes the theme in every base */
+    char *data = NULL;
+    size_t size = 0;
+    for(int b = 0; b < num_bases && !data; b++) {
+        char path[1100];
+        snprintf(path, sizeof(path), "%s/%s/index.theme", bases[b],
+                 themes[theme]);
+        data = read_file(path, &size);
+    }
+    if(!data) {
+        guess_theme_dirs(theme);
+        return;
+    }
+
+    const char *inherits = NULL;
+    size_t inherits_len = 0;
+    parse_index_theme(theme, data, size, &inherits, &inherits_len);
+
+    const char *list = inherits, *item;
+    size_t item_len;
+    while(inherits &&
+          next_item(&list, inherits + inherits_len, ',', &item, &item_len))
+        add_theme(item, item_len);
+    free(data);
+}
+
+static void resolve_themes() {
+    resolve_bases();
+    add_theme(theme_name, strlen(theme_name));
+    /* Every chain ends in hicolor */
+    add_theme("hicolor", 7);
+
+    struct stat st;
+    if(stat(ICON_PIXMAPS, &st) == 0 && S_ISDIR(st.st_mode) &&
+       grow((void **)&dirs, &dirs_cap, num_dirs, sizeof(*dirs))) {
+        stamp_mtime(&st);
+        char *path = arena_copy(ICON_PIXMAPS, strlen(ICON_PIXMAPS));
+        if(path) {
+            pixmaps_dir = num_dirs++;
+            dirs[pixmaps_dir] = (IconDir){path, path, num_themes,
+                                          ICON_DIR_FIXED, 0, 0, 0, 0};
+        }
+    }
+}
+
+static uint32_t hash_name(const char *s, size_t len) {
+    return hash_bytes(2166136261u, s, len);
+}
+
+static IconName *find_name(const char *s, size_t len) {
+    for(uint32_t i = hash_name(s, len) & names_mask;;
+        i = (i + 1) & names_mask) {
+        IconName *n = &names[i];
+        if(!n->name || (n->len == len && memcmp(n->name, s, len) == 0))
+            return n;
+    }
+}
+
+static bool grow_names() {
+    uint32_t old_size = names ? names_mask + 1 : 0;
+    uint32_t size = old_size ? old_size * 2 : 1024;
+    IconName *table = calloc(size, sizeof(*table));
+    if(!table) return false;
+    IconName *old = names;
+    names = table;
+    names_mask = size - 1;
+    for(uint32_t i = 0; i < old_size; i++)
+        if(old[i].name) *find_name(old[i].name, old[i].len) = old[i];
+    free(old);
+    return true;
+}
+
+static void add_image(const char *name, size_t len, uint32_t dir) {
+    /* Keep the load factor at or below 1/2 */
+    if((!names || (names_used + 1) * 2 > names_mask + 1) && !grow_names())
+        return;
+    if(!grow((void **)&images, &images_cap, num_images, sizeof(*images)))
+        return;
+
+    IconName *n = find_name(name, len);
+    if(!n->name) {
+        n->name = arena_copy(name, len);
+        if(!n->name) return;
+        n->len = len;
+        n->first = 0;
+        names_used++;
+    }
+    images[num_images] = (IconImage){dir, n->first};
+    n->first = ++num_images;
+}
+
+static void scan_dir(uint32_t dir) {
+    DIR *d = opendir(dirs[dir].path);
+    if(!d) return;
+    struct dirent *entry;
+    while((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if(len > 4 && strcmp(entry->d_name + len - 4, ".png") == 0)
+            add_image(entry->d_name, len - 4, dir);
+    }
+    closedir(d);
+}
+
+static bool cache_u32(const uint8_t *data, size_t size, uint32_t offset,
+                      uint32_t *out) {
+    if(size < 4 || offset > size - 4) return false;
+    const uint8_t *p = data + offset;
+    *out = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+           p[3];
+    return true;
+}
+
+static const char *cache_string(const uint8_t *data, size_t size,
+                                uint32_t offset) {
+    if(offset >= size || !memchr(data + offset, '\0', size - offset))
+        return NULL;
+    return (const char *)data + offset;
+}
+
+/**
+ * Index a theme root from the icon-theme.cache written by
+ * gtk-update-icon-cache. Big endian: a header, a directory list and a
+ * hash of icon names, each with its images per directory. Returns false
+ * if there is no usable cache
+ */
+static bool load_cache(const ThemeRoot *root) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/icon-theme.cache", root->path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+
+    /* A cache older than its theme directory misses icons */
+    struct stat st, root_st;
+    if(fstat(fd, &st) < 0 || stat(root->path, &root_st) < 0 ||
+       st.st_mtime < root_st.st_mtime || st.st_size < 12) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    const uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return false;
+
+    uint32_t hash_offset, list_offset, num_cache_dirs, num_buckets;
+    int32_t *dir_map = NULL;
+    bool ok = data[0] == 0 && data[1] == 1 &&
+              cache_u32(data, size, 4, &hash_offset) &&
+              cache_u32(data, size, 8, &list_offset) &&
+              cache_u32(data, size, list_offset, &num_cache_dirs) &&
+              num_cache_dirs <= size / 4 &&
+              cache_u32(data, size, hash_offset, &num_buckets) &&
+              num_buckets <= size / 4 &&
+              (dir_map = malloc((num_cache_dirs + 1) * sizeof(*dir_map)));
+
+    /* Cache directories to ours, -1 for ones index.theme does not list */
+    for(uint32_t i = 0; ok && i < num_cache_dirs; i++) {
+        uint32_t offset;
+        const char *name = NULL;
+        ok = cache_u32(data, size, list_offset + 4 + i * 4, &offset) &&
+             (name = cache_string(data, size, offset));
+        dir_map[i] = -1;
+        for(uint32_t d = 0; ok && d < root->num_dirs; d++) {
+            if(strcmp(dirs[root->first_dir + d].subdir, name) != 0) continue;
+            dir_map[i] = root->first_dir + d;
+            break;
+        }
+    }
+
+    /* Bounds every chain walk, a corrupt cache could loop */
+    uint32_t budget = size / 12;
+    for(uint32_t b = 0; ok && b < num_buckets; b++) {
+        uint32_t icon;
+        ok = cache_u32(data, size, hash_offset + 4 + b * 4, &icon);
+        while(ok && icon != 0xffffffff) {
+            uint32_t chain, name_offset, list, count;
+            const char *name = NULL;
+            ok = budget-- > 0 && cache_u32(data, size, icon, &chain) &&
+                 cache_u32(data, size, icon + 4, &name_offset) &&
+                 cache_u32(data, size, icon + 8, &list) &&
+                 cache_u32(data, size, list, &count) &&
+                 (name = cache_string(data, size, name_offset)) &&
+                 count <= (size - list - 4) / 8;
+            for(uint32_t i = 0; ok && i < count; i++) {
+                const uint8_t *image = data + list + 4 + i * 8;
+                uint32_t dir = (uint32_t)image[0] << 8 | image[1];
+                uint32_t flags = (uint32_t)image[2] << 8 | image[3];
+                if(dir < num_cache_dirs && dir_map[dir] >= 0 &&
+                   (flags & CACHE_HAS_PNG))
+                    add_image(name, strlen(name), dir_map[dir]);
+            }
+            icon = chain;
+        }
+    }
+
+    free(dir_map);
+    munmap((void *)data, size);
+    if(!ok) mocha_log("Icon theme: ignoring corrupt %s", path);
+    return ok;
+}
+
+static void build_index() {
+    pthread_once(&themes_once, resolve_themes);
+    int cached = 0;
+    for(int i = 0; i < num_roots; i++) {
+        if(load_cache(&roots[i])) {
+            cached++;
+            continue;
+        }
+        for(uint32_t d = 0; d < roots[i].num_dirs; d++)
+            scan_dir(roots[i].first_dir + d);
+    }
+    if(pixmaps_dir >= 0) scan_dir(pixmaps_dir);
+    mocha_log("Icon theme: %s, %d themes, %u icons (%d of %d roots cached)",
+              theme_name, num_themes, names_used, cached, num_roots);
+}
+
+/**
+ * Set the theme to look icons up in, hicolor if never called. Only takes
+ * effect before the first lookup
+ */
+void mocha_icon_theme_init(const char *theme) {
+    if(theme && theme[0]) snprintf(theme_name, sizeof(theme_name), "%s", theme);
+}
+
+/**
+ * Changes whenever the theme chain or one of its directories changes,
+ * for invalidating icon paths cached elsewhere
+ */
+uint32_t mocha_icon_theme_stamp() {
+    pthread_once(&themes_once, resolve_themes);
+    return theme_stamp;
+}
+
+static int size_distance(const IconDir *d, int size) {
+    int lo = d->size, hi = d->size;
+    if(d->type == ICON_DIR_SCALABLE) {
+        lo = d->min_size;
+        hi = d->max_size;
+    } else if(d->type == ICON_DIR_THRESHOLD) {
+        lo = d->size - d->threshold;
+        hi = d->size + d->threshold;
+    }
+    if(size < lo) return lo - size;
+    if(size > hi) return size - hi;
+    return 0;
+}
+
+/**
+ * Whether d is a better match than best. Earlier themes win, then the
+ * closest size, then the larger image since scaling down looks better
+ */
+static bool better_match(const IconDir *d, int dist, const IconDir *best,
+                         int best_dist) {
+    if(!best) return true;
+    if(d->theme != best->theme) return d->theme < best->theme;
+    if(dist != best_dist) return dist < best_dist;
+    return d->size > best->size;
+}
+
+/**
+ * Find the best image of an icon for a pixel size and write its path.
+ * Thread safe, the index is built by the first call. Returns false if
+ * the icon is not in any theme
+ */
+bool mocha_icon_theme_lookup(const char *name, int size, char *path,
+                             size_t len) {
+    if(!name || !name[0]) return false;
+    pthread_once(&index_once, build_index);
+    if(!names) return false;
+
+    /* Some entries name a file rather than an icon */
+    size_t name_len = strlen(name);
+    if(name_len > 4 && (strcmp(name + name_len - 4, ".png") == 0 ||
+                        strcmp(name + name_len - 4, ".svg") == 0 ||
+                        strcmp(name + name_len - 4, ".xpm") == 0))
+        name_len -= 4;
+
+    const IconName *n = find_name(name, name_len);
+    const IconDir *best = NULL;
+    int best_dist = 0;
+    for(uint32_t i = n->name ? n->first : 0; i; i = images[i - 1].next) {
+        const IconDir *d = &dirs[images[i - 1].dir];
+        int dist = size_distance(d, size);
+        if(!better_match(d, dist, best, best_dist)) continue;
+        best = d;
+        best_dist = dist;
+    }
+    if(!best) return false;
+    return snprintf(path, len, "%s/%.*s.png", best->path, (int)n->len,
+                    n->name) < (int)len;
+}
@@ -0,0 +1,110 @@
+#include "util/intern.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+
+/*
+ * String pool. Bytes come from fixed-size arena blocks, and an
+ * open-addressing table with linear probing maps contents to the one
+ * stored copy. Nothing is ever removed.
+ */
+
+#define INTERN_BLOCK_SIZE 4096
+#define INTERN_TABLE_MIN 64
+
+typedef struct {
+    const char *str;
+    uint32_t hash;
+} InternEntry;
+
+static InternEntry *table = NULL;
+static uint32_t table_mask = 0;
+static uint32_t table_used = 0;
+
+static char *block = NULL;
+static size_t block_left = 0;
+
+static uint32_t hash_string(const char *s) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for(; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static int table_resize(uint32_t size) {
+    InternEntry *new_table = calloc(size, sizeof(*new_table));
+    if(!new_table) return -1;
+    for(uint32_t i = 0; table && i <= table_mask; i++) {
+        if(!table[i].str) continue;
+        uint32_t pos = table[i].hash & (size - 1);
+        while(new_table[pos].str) pos = (pos + 1) & (size - 1);
+        new_table[pos] = table[i];
+    }
+    free(table);
+    table = new_table;
+    table_mask = size - 1;
+    return 0;
+}
+
+static InternEntry *lookup(const char *s, uint32_t hash) {
+    if(!table) return NULL;
+    uint32_t pos = hash & table_mask;
+    while(table[pos].str) {
+        if(table[pos].hash == hash && strcmp(table[pos].str, s) == 0)
+            return &table[pos];
+        pos = (pos + 1) & table_mask;
+    }
+    return &table[pos];
+}
+
+static char *store(const char *s) {
+    size_t len = strlen(s) + 1;
+    /* Long strings get their own allocation instead of wasting a block */
+    if(len > INTERN_BLOCK_SIZE / 4) return strdup(s);
+    if(len > block_left) {
+        block = malloc(INTERN_BLOCK_SIZE);
+        if(!block) {
+            block_left = 0;
+            return NULL;
+        }
+        block_left = INTERN_BLOCK_SIZE;
+    }
+    char *copy = block;
+    memcpy(copy, s, len);
+    block += len;
+    block_left -= len;
+    return copy;
+}
+
+const char *mocha_intern(const char *s) {
+    if(!s) return NULL;
+    uint32_t hash = hash_string(s);
+    InternEntry *e = lookup(s, hash);
+    if(e && e->str) return e->str;
+
+    /* Keep the load factor at or below 1/2 */
+    if(!table || (table_used + 1) * 2 > table_mask + 1) {
+        if(table_resize(table ? (table_mask + 1) * 2 : INTERN_TABLE_MIN) < 0)
+            return NULL;
+        e = lookup(s, hash);
+    }
+
+    char *copy = store(s);
+    if(!copy) {
+        mocha_log("Intern: out of memory");
+        return NULL;
+    }
+    e->str = copy;
+    e->hash = hash;
+    table_used++;
+    return copy;
+}
+
+const char *mocha_intern_find(const char *s) {
+    if(!s) return NULL;
+    InternEntry *e = lookup(s, hash_string(s));
+    return e ? e->str : NULL;
+}
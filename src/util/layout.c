@@ -0,0 +1,126 @@
+#include "util/layout.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "ui/shape.h"
+#include "util/config.h"
+
+/*
+ * Layouts only compute target rectangles. mocha_layout_apply() diffs them
+ * against each client's cached geometry and configures only the windows
+ * whose slot actually changed, so untouched apps get no ConfigureNotify
+ * and no repaint.
+ */
+
+static void arrange_master_stack(const MochaRect *area, int n, int gap,
+                                 MochaRect *out) {
+    int master_w = n > 1 ? area->w / 2 - gap / 2 : area->w;
+    int stack_w = area->w - master_w - gap;
+    int stack_count = n - 1;
+    int stack_h = stack_count > 0
+                      ? (area->h - (stack_count - 1) * gap) / stack_count
+                      : 0;
+
+    out[0] = (MochaRect){area->x, area->y, master_w, area->h};
+    for(int i = 1; i < n; i++) {
+        out[i] = (MochaRect){area->x + master_w + gap,
+                             area->y + (i - 1) * (stack_h + gap), stack_w,
+                             stack_h};
+    }
+}
+
+static void arrange_grid(const MochaRect *area, int n, int gap,
+                         MochaRect *out) {
+    int cols = (int)ceil(sqrt(n));
+    int rows = (n + cols - 1) / cols;
+    int cell_h = (area->h - (rows - 1) * gap) / rows;
+
+    for(int i = 0; i < n; i++) {
+        int row = i / cols;
+        /* The last row shares its width between fewer windows */
+        int row_cols = row == rows - 1 ? n - row * cols : cols;
+        int col = i % cols;
+        int cell_w = (area->w - (row_cols - 1) * gap) / row_cols;
+        out[i] = (MochaRect){area->x + col * (cell_w + gap),
+                             area->y + row * (cell_h + gap), cell_w, cell_h};
+    }
+}
+
+static void arrange_monocle(const MochaRect *area, int n, int gap,
+                            MochaRect *out) {
+    for(int i = 0; i < n; i++) out[i] = *area;
+}
+
+const Layout layout_master_stack = {"master_stack", arrange_master_stack};
+const Layout layout_grid = {"grid", arrange_grid};
+const Layout layout_monocle = {"monocle", arrange_monocle};
+
+static const Layout *layouts[] = {&layout_master_stack, &layout_grid,
+                                  &layout_monocle};
+#define NUM_LAYOUTS (int)(sizeof(layouts) / sizeof(layouts[0]))
+
+/**
+ * Look up a layout by its config name, defaults to master_stack
+ */
+const Layout *mocha_layout_by_name(const char *name) {
+    for(int i = 0; name && i < NUM_LAYOUTS; i++) {
+        if(strcmp(layouts[i]->name, name) == 0) return layouts[i];
+    }
+    return &layout_master_stack;
+}
+
+const Layout *mocha_layout_next(const Layout *current) {
+    for(int i = 0; i < NUM_LAYOUTS; i++) {
+        if(layouts[i] == current) return layouts[(i + 1) % NUM_LAYOUTS];
+    }
+    return layouts[0];
+}
+
+/**
+ * Lay out clients inside area, returns how many windows were reconfigured
+ */
+int mocha_layout_apply(const Layout *layout, const MochaRect *area, int gap,
+                       Client **clients, int n) {
+    static MochaRect *targets = NULL;
+    static int targets_cap = 0;
+
+    if(n <= 0) return 0;
+    if(n > targets_cap) {
+        int cap = targets_cap ? targets_cap : 16;
+        while(cap < n) cap *= 2;
+        MochaRect *grown = realloc(targets, cap * sizeof(*grown));
+        if(!grown) return 0;
+        targets = grown;
+        targets_cap = cap;
+    }
+    layout->arrange(area, n, gap, targets);
+
+    int touched = 0;
+    for(int i = 0; i < n; i++) {
+        Client *c = clients[i];
+        int border = c->border;
+        int w = targets[i].w - 2 * border;
+        int h = targets[i].h - 2 * border;
+        if(w < 1) w = 1;
+        if(h < 1) h = 1;
+
+        int moved = c->x != targets[i].x || c->y != targets[i].y;
+        int resized = c->w != w || c->h != h;
+        if(moved && resized)
+            mocha_client_move_resize(c, targets[i].x, targets[i].y, w, h);
+        else if(moved)
+            mocha_client_move(c, targets[i].x, targets[i].y);
+        else if(resized)
+            mocha_client_resize(c, w, h);
+        else
+            continue;
+        if(resized)
+            mocha_shape_round_corners(c->window, w, h,
+                                      config.features.border_radius);
+        touched++;
+    }
+    return touched;
+}
@@ -0,0 +1,92 @@
+#include "util/loop.h"
+
+#include <X11/Xlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+
+#include "main.h"
+
+struct LoopWatch {
+    int fd;
+    MochaLoopCallback callback;
+    void *data;
+};
+
+static struct LoopWatch watches[MAX_LOOP_FDS];
+static int num_watches = 0;
+static int loop_running = 0;
+
+/**
+ * Watch a file descriptor, callback runs on the main thread when readable
+ */
+int mocha_loop_add_fd(int fd, MochaLoopCallback callback, void *data) {
+    if(fd < 0 || num_watches >= MAX_LOOP_FDS) {
+        mocha_log("Loop] Cannot watch fd %d", fd);
+        return -1;
+    }
+    watches[num_watches].fd = fd;
+    watches[num_watches].callback = callback;
+    watches[num_watches].data = data;
+    num_watches++;
+    return 0;
+}
+
+/**
+ * Stop watching a file descriptor
+ */
+void mocha_loop_remove_fd(int fd) {
+    for(int i = 0; i < num_watches; i++) {
+        if(watches[i].fd == fd) {
+            watches[i] = watches[--num_watches];
+            return;
+        }
+    }
+}
+
+/**
+ * Run until mocha_loop_quit(), dispatch_x handles everything queued on the
+ * X connection
+ */
+void mocha_loop_run(void (*dispatch_x)(void *data), void *data) {
+    struct pollfd fds[MAX_LOOP_FDS + 1];
+    struct LoopWatch ready[MAX_LOOP_FDS];
+
+    loop_running = 1;
+    while(loop_running) {
+        /* Callbacks may have queued requests, and Xlib may already hold
+           events it read while waiting for a reply */
+        XFlush(dpy);
+        int timeout = XEventsQueued(dpy, QueuedAlready) > 0 ? 0 : -1;
+
+        fds[0].fd = ConnectionNumber(dpy);
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        int n = num_watches;
+        for(int i = 0; i < n; i++) {
+            fds[i + 1].fd = watches[i].fd;
+            fds[i + 1].events = POLLIN;
+            fds[i + 1].revents = 0;
+            ready[i] = watches[i];
+        }
+
+        if(poll(fds, n + 1, timeout) < 0) {
+            if(errno == EINTR) continue;
+            mocha_log("Loop] poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if(timeout == 0 || fds[0].revents) dispatch_x(data);
+
+        /* Watches are copied so callbacks can add or remove fds safely */
+        for(int i = 0; i < n; i++) {
+            if(fds[i + 1].revents)
+                ready[i].callback(ready[i].fd, ready[i].data);
+        }
+    }
+}
+
+/**
+ * Make mocha_loop_run() return after the current iteration
+ */
+void mocha_loop_quit() { loop_running = 0; }
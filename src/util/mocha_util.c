@@ -1,12 +1,21 @@
 #define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "main.h"
 #include "ui/toast.h"
+#include "util/spawn.h"
+#include "util/stats.h"
 
 /**
  * A simple util to print out with Mocha prefix
@@ -21,6 +30,35 @@ void mocha_log(const char *fmt, ...) {
     va_end(args);
 }
 
+static void make_dirs(char *path) {
+    for(char *p = path + 1; *p; p++) {
+        if(*p != '/') continue;
+        *p = '\0';
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    mkdir(path, 0755);
+}
+
+/**
+ * Path of a file in the cache directory, $XDG_CACHE_HOME/mocha or
+ * ~/.cache/mocha. Creates the directory, returns 0 if there is no usable
+ * location
+ */
+int mocha_cache_path(const char *name, char *buf, int len) {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[1024];
+    if(cache && cache[0] == '/')
+        snprintf(dir, sizeof(dir), "%s/mocha", cache);
+    else if(home && home[0])
+        snprintf(dir, sizeof(dir), "%s/.cache/mocha", home);
+    else
+        return 0;
+    make_dirs(dir);
+    return snprintf(buf, len, "%s/%s", dir, name) < len;
+}
+
 /**
  * A simple util to display errors
  */
@@ -70,20 +108,101 @@ int handleXError(Display *dpy, XErrorEvent *e) {
     return 0;
 }
 
+static int trapped_errors = 0;
+static XErrorHandler trap_previous_handler = NULL;
+
+static int trap_error_handler(Display *dpy, XErrorEvent *e) {
+    trapped_errors++;
+    return 0;
+}
+
+/**
+ * Start collecting X errors instead of logging them
+ */
+void mocha_trap_errors() {
+    trapped_errors = 0;
+    trap_previous_handler = XSetErrorHandler(trap_error_handler);
+}
+
+/**
+ * Sync with the server and stop trapping, returns the number of errors seen
+ */
+int mocha_untrap_errors() {
+    mocha_stats_roundtrip();
+    XSync(dpy, False);
+    XSetErrorHandler(trap_previous_handler);
+    return trapped_errors;
+}
+
+/**
+ * Commit the requests queued while handling a batch of events
+ */
+void mocha_commit() {
+    XFlush(dpy);
+    mocha_stats.batches++;
+    mocha_stats.current_event = 0;
+}
+
+/**
+ * system() replacement that gives the shell a clean signal mask
+ */
+int mocha_system(const char *cmd) {
+    char *argv[] = {"sh", "-c", (char *)cmd, NULL};
+    posix_spawnattr_t attr;
+    pid_t pid;
+    int status;
+
+    mocha_spawn_attr_init(&attr, 0);
+    int err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    if(err != 0) return -1;
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) return -1;
+    }
+    return status;
+}
+
 /**
  * Util to run a shell command and capture its output as a string
  */
 int run_command(const char *cmd, char *buf, size_t buflen) {
-    FILE *fp = popen(cmd, "r");
-    if(!fp) return -1;
-    size_t n = fread(buf, 1, buflen - 1, fp);
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC) < 0) return -1;
+
+    char *argv[] = {"sh", "-c", (char *)cmd, NULL};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawnattr_t attr;
+    mocha_spawn_attr_init(&attr, 0);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+    if(err != 0) {
+        close(fds[0]);
+        return -1;
+    }
+
+    size_t n = 0;
+    while(n < buflen - 1) {
+        ssize_t r = read(fds[0], buf + n, buflen - 1 - n);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) break;
+        n += r;
+    }
     buf[n] = '\0';
-    pclose(fp);
+    close(fds[0]);
+    while(waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+    }
     return 0;
 }
 
 void mocha_shutdown() {
     mocha_log("Mocha is shutting down...");
     cleanup_toasts();
-    system("pkill -u $(whoami)");
+    mocha_stats_log();
+    mocha_system("pkill -u $(whoami)");
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "util/monitor.h"
+
+#include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
+#include <string.h>
+
+#include "main.h"
+#include "util/pointer.h"
+#include "util/stats.h"
+#include "util/workspace.h"
+
+/*
+ * Output regions come from RandR when the server has it, Xinerama
+ * otherwise, and the whole screen as a last resort. Mirrored outputs
+ * share a rectangle and collapse into one monitor.
+ */
+
+Monitor monitors[MAX_MONITORS];
+int num_monitors = 0;
+
+static int has_randr = 0;
+static int randr_event_base = 0;
+static const Layout *default_layout = NULL;
+
+static int add_region(MochaRect *regions, int n, int x, int y, int w, int h) {
+    if(w <= 0 || h <= 0 || n >= MAX_MONITORS) return n;
+    for(int i = 0; i < n; i++) {
+        if(regions[i].x == x && regions[i].y == y && regions[i].w == w &&
+           regions[i].h == h)
+            return n;
+    }
+    regions[n] = (MochaRect){x, y, w, h};
+    return n + 1;
+}
+
+static int query_randr(MochaRect *regions) {
+    mocha_stats_roundtrip();
+    XRRScreenResources *res = XRRGetScreenResourcesCurrent(dpy, root);
+    if(!res) return 0;
+
+    RRCrtc primary_crtc = None;
+    RROutput primary = XRRGetOutputPrimary(dpy, root);
+    if(primary != None) {
+        XRROutputInfo *output = XRRGetOutputInfo(dpy, res, primary);
+        if(output) {
+            primary_crtc = output->crtc;
+            XRRFreeOutputInfo(output);
+        }
+    }
+
+    int n = 0;
+    for(int i = 0; i < res->ncrtc; i++) {
+        XRRCrtcInfo *crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[i]);
+        if(!crtc) continue;
+        if(crtc->mode != None && crtc->noutput > 0) {
+            int added = add_region(regions, n, crtc->x, crtc->y, crtc->width,
+                                   crtc->height);
+            /* The primary output always becomes monitor 0 */
+            if(added > n && res->crtcs[i] == primary_crtc && n > 0) {
+                MochaRect first = regions[n];
+                memmove(&regions[1], &regions[0], n * sizeof(*regions));
+                regions[0] = first;
+            }
+            n = added;
+        }
+        XRRFreeCrtcInfo(crtc);
+    }
+    XRRFreeScreenResources(res);
+    return n;
+}
+
+static int query_xinerama(MochaRect *regions) {
+    if(!XineramaIsActive(dpy)) return 0;
+    int count = 0;
+    mocha_stats_roundtrip();
+    XineramaScreenInfo *info = XineramaQueryScreens(dpy, &count);
+    if(!info) return 0;
+    int n = 0;
+    for(int i = 0; i < count; i++)
+        n = add_region(regions, n, info[i].x_org, info[i].y_org,
+                       info[i].width, info[i].height);
+    XFree(info);
+    return n;
+}
+
+/**
+ * Requery the outputs. Monitors whose rectangle is unchanged keep their
+ * layout and stay clean, everything else is marked dirty. Clients are
+ * carried over to the matching monitor or rehomed by their position
+ */
+static void refresh_monitors() {
+    MochaRect regions[MAX_MONITORS];
+    int n = has_randr ? query_randr(regions) : 0;
+    if(n == 0) n = query_xinerama(regions);
+    if(n == 0)
+        n = add_region(regions, 0, 0, 0, DisplayWidth(dpy, screen),
+                       DisplayHeight(dpy, screen));
+
+    Monitor old[MAX_MONITORS];
+    int old_n = num_monitors;
+    int old_to_new[MAX_MONITORS];
+    memcpy(old, monitors, sizeof(old));
+    for(int i = 0; i < old_n; i++) old_to_new[i] = -1;
+
+    unsigned int changed = 0;
+    for(int i = 0; i < n; i++) {
+        Monitor *m = &monitors[i];
+        *m = (Monitor){regions[i].x, regions[i].y, regions[i].w, regions[i].h,
+                       default_layout, 1};
+        int resized = 1, renumbered = 0;
+        /* Match on the origin so a mode change keeps its layout */
+        for(int j = 0; j < old_n; j++) {
+            if(old_to_new[j] >= 0 || old[j].x != m->x || old[j].y != m->y)
+                continue;
+            old_to_new[j] = i;
+            m->layout = old[j].layout;
+            resized = old[j].w != m->w || old[j].h != m->h ||
+                      (i == 0) != (j == 0);
+            m->dirty = resized || old[j].dirty;
+            renumbered = i != j;
+            break;
+        }
+        /* A renumbered monitor is fine on screen, but hidden layouts were
+           computed for its old index */
+        if(resized || renumbered) changed |= 1u << i;
+    }
+    num_monitors = n;
+
+    /* Hidden workspaces keep their pending passes under the new indices
+       and get the same passes as the shown one once they are shown */
+    mocha_workspace_remap_monitors(old_to_new, old_n);
+    mocha_workspace_invalidate(changed);
+
+    for(Client *c = mocha_client_first(); c; c = mocha_client_next(c)) {
+        int m = c->monitor < old_n ? old_to_new[c->monitor] : -1;
+        if(m < 0) {
+            c->monitor = mocha_monitor_of_client(c);
+            mocha_request_retile_client(c);
+        } else {
+            c->monitor = m;
+        }
+    }
+
+    for(int i = 0; i < n; i++)
+        mocha_log("Monitor %d: %dx%d+%d+%d (%s)", i, monitors[i].w,
+                  monitors[i].h, monitors[i].x, monitors[i].y,
+                  monitors[i].layout->name);
+}
+
+/**
+ * Query the outputs and start listening for changes, layout is the
+ * initial layout of every monitor
+ */
+void mocha_monitor_init(const Layout *layout) {
+    default_layout = layout;
+    int error_base;
+    if(XRRQueryExtension(dpy, &randr_event_base, &error_base)) {
+        has_randr = 1;
+        XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+    } else {
+        mocha_log("RandR not available, falling back to Xinerama");
+    }
+    refresh_monitors();
+}
+
+/**
+ * Handle RandR screen changes, returns 1 if the monitors were requeried
+ */
+int mocha_monitor_handle_event(XEvent *e) {
+    if(!has_randr || e->type != randr_event_base + RRScreenChangeNotify)
+        return 0;
+    XRRUpdateConfiguration(e);
+    refresh_monitors();
+    return 1;
+}
+
+static long axis_distance(int v, int start, int len) {
+    if(v < start) return start - v;
+    if(v >= start + len) return v - (start + len - 1);
+    return 0;
+}
+
+/**
+ * Monitor containing a root point, the nearest one if it is off every
+ * output
+ */
+int mocha_monitor_at(int x, int y) {
+    int best = 0;
+    long best_dist = -1;
+    for(int i = 0; i < num_monitors; i++) {
+        const Monitor *m = &monitors[i];
+        long dx = axis_distance(x, m->x, m->w);
+        long dy = axis_distance(y, m->y, m->h);
+        long dist = dx * dx + dy * dy;
+        if(dist == 0) return i;
+        if(best_dist < 0 || dist < best_dist) {
+            best = i;
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
+int mocha_monitor_of_client(const Client *c) {
+    return mocha_monitor_at(c->x + c->w / 2, c->y + c->h / 2);
+}
+
+Monitor *mocha_monitor_under_pointer() {
+    int x, y;
+    mocha_pointer_position(&x, &y);
+    return &monitors[mocha_monitor_at(x, y)];
+}
@@ -0,0 +1,122 @@
+#include "util/pixel.h"
+
+#include <pthread.h>
+
+#include "main.h"
+
+#ifdef PIXEL_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * Conversion of decoded RGBA bytes into cairo's premultiplied ARGB32.
+ * Every kernel rounds x * a / 255 to nearest, like pixman does, so they
+ * agree bit for bit and the choice between them is only about speed. The
+ * kernel is picked once from the CPU features.
+ */
+
+typedef void (*PixelKernel)(uint8_t *data, size_t count);
+
+static PixelKernel kernel;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+void mocha_pixel_rgba_to_argb32_scalar(uint8_t *data, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        uint8_t *p = data + 4 * i;
+        uint32_t a = p[3];
+        uint32_t r = mocha_pixel_mul_div255(p[0], a);
+        uint32_t g = mocha_pixel_mul_div255(p[1], a);
+        uint32_t b = mocha_pixel_mul_div255(p[2], a);
+        ((uint32_t *)data)[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+#ifdef PIXEL_X86
+
+/*
+ * The SIMD kernels widen to 16 bit lanes holding B G R A per pixel, so
+ * the stores come out as ARGB32 on little endian x86. Alpha is multiplied
+ * by 255, which the division turns back into itself.
+ */
+
+__attribute__((target("sse2"))) static inline __m128i premultiply_sse2(
+    __m128i px) {
+    px = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    px = _mm_shufflehi_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    __m128i alpha = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha),
+                         _mm_and_si128(alpha_lanes, _mm_set1_epi16(255)));
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, alpha), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2"))) void mocha_pixel_rgba_to_argb32_sse2(
+    uint8_t *data, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i *p = (__m128i *)(data + 4 * i);
+        __m128i px = _mm_loadu_si128(p);
+        __m128i lo = premultiply_sse2(_mm_unpacklo_epi8(px, zero));
+        __m128i hi = premultiply_sse2(_mm_unpackhi_epi8(px, zero));
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    mocha_pixel_rgba_to_argb32_scalar(data + 4 * i, count - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256i premultiply_avx2(
+    __m256i px) {
+    px = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    px = _mm256_shufflehi_epi16(px, _MM_SHUFFLE(3, 0, 1, 2));
+    __m256i alpha = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_blend_epi16(alpha, _mm256_set1_epi16(255), 0x88);
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, alpha),
+                                 _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+/* Unpack and pack both work within 128 bit halves, so pixel order is
+   kept without any cross lane shuffles */
+__attribute__((target("avx2"))) void mocha_pixel_rgba_to_argb32_avx2(
+    uint8_t *data, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i *p = (__m256i *)(data + 4 * i);
+        __m256i px = _mm256_loadu_si256(p);
+        __m256i lo = premultiply_avx2(_mm256_unpacklo_epi8(px, zero));
+        __m256i hi = premultiply_avx2(_mm256_unpackhi_epi8(px, zero));
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    mocha_pixel_rgba_to_argb32_sse2(data + 4 * i, count - i);
+}
+
+#endif  // PIXEL_X86
+
+static void pick_kernel() {
+    const char *name = "scalar";
+    kernel = mocha_pixel_rgba_to_argb32_scalar;
+#ifdef PIXEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        kernel = mocha_pixel_rgba_to_argb32_avx2;
+    } else if(__builtin_cpu_supports("sse2")) {
+        name = "sse2";
+        kernel = mocha_pixel_rgba_to_argb32_sse2;
+    }
+#endif
+    mocha_log("Pixel conversion: %s", name);
+}
+
+/**
+ * Convert count RGBA pixels in place into premultiplied ARGB32 in native
+ * byte order, as cairo wants them
+ */
+void mocha_pixel_rgba_to_argb32(uint8_t *data, size_t count) {
+    pthread_once(&kernel_once, pick_kernel);
+    kernel(data, count);
+}
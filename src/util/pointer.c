@@ -0,0 +1,277 @@
+#include "util/pointer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "util/stats.h"
+
+/*
+ * Local mirror of the pointer position and of the root window's children
+ * in stacking order, so "which window is under the pointer" does not need
+ * an XQueryPointer round trip. The mirror is fed by the structure events
+ * the WM already selects on root.
+ */
+
+typedef struct {
+    Window window;
+    int x, y, w, h, border;
+    int mapped;
+} StackEntry;
+
+/* Bottom to top, like XQueryTree */
+static StackEntry *stack = NULL;
+static int stack_len = 0;
+static int stack_cap = 0;
+static int stack_valid = 0;
+
+static int pointer_x, pointer_y;
+static int pointer_valid = 0;
+
+static int stack_find(Window w) {
+    for(int i = stack_len - 1; i >= 0; i--) {
+        if(stack[i].window == w) return i;
+    }
+    return -1;
+}
+
+static StackEntry *stack_insert(int index, Window w) {
+    if(stack_len == stack_cap) {
+        int cap = stack_cap ? stack_cap * 2 : 64;
+        StackEntry *grown = realloc(stack, cap * sizeof(*grown));
+        if(!grown) {
+            stack_valid = 0;
+            return NULL;
+        }
+        stack = grown;
+        stack_cap = cap;
+    }
+    memmove(&stack[index + 1], &stack[index],
+            (stack_len - index) * sizeof(*stack));
+    stack_len++;
+    memset(&stack[index], 0, sizeof(*stack));
+    stack[index].window = w;
+    return &stack[index];
+}
+
+static void stack_remove(int index) {
+    memmove(&stack[index], &stack[index + 1],
+            (stack_len - index - 1) * sizeof(*stack));
+    stack_len--;
+}
+
+/* Move the entry at index so that it sits directly above sibling */
+static void stack_restack(int index, Window sibling) {
+    StackEntry entry = stack[index];
+    int target = 0;
+    if(sibling != None) {
+        int s = stack_find(sibling);
+        if(s < 0) {
+            stack_valid = 0;
+            return;
+        }
+        target = s < index ? s + 1 : s;
+    }
+    if(target == index) return;
+    stack_remove(index);
+    memmove(&stack[target + 1], &stack[target],
+            (stack_len - target) * sizeof(*stack));
+    stack[target] = entry;
+    stack_len++;
+}
+
+static void set_entry_geometry(StackEntry *s, const XWindowAttributes *attr) {
+    s->x = attr->x;
+    s->y = attr->y;
+    s->w = attr->width;
+    s->h = attr->height;
+    s->border = attr->border_width;
+    s->mapped = attr->map_state != IsUnmapped;
+}
+
+/**
+ * Rebuild the stacking mirror from the server, reusing known geometry
+ */
+static void stack_sync() {
+    Window root_ret, parent_ret, *children = NULL;
+    unsigned int n = 0;
+
+    mocha_stats_roundtrip();
+    if(!XQueryTree(dpy, root, &root_ret, &parent_ret, &children, &n)) return;
+
+    StackEntry *old = stack;
+    int old_len = stack_len;
+    stack = NULL;
+    stack_len = stack_cap = 0;
+    stack_valid = 1;
+
+    for(unsigned int i = 0; i < n; i++) {
+        StackEntry *known = NULL;
+        for(int j = 0; j < old_len; j++) {
+            if(old[j].window == children[i]) {
+                known = &old[j];
+                break;
+            }
+        }
+        StackEntry *s = stack_insert(stack_len, children[i]);
+        if(!s) break;
+        if(known) {
+            *s = *known;
+        } else {
+            XWindowAttributes attr;
+            mocha_stats_roundtrip();
+            if(XGetWindowAttributes(dpy, children[i], &attr))
+                set_entry_geometry(s, &attr);
+        }
+    }
+    if(children) XFree(children);
+    free(old);
+}
+
+/**
+ * Build the initial stacking mirror, call once root's structure events
+ * are selected
+ */
+void mocha_stack_init() { stack_sync(); }
+
+static void set_pointer(int x, int y, Bool same_screen) {
+    pointer_x = x;
+    pointer_y = y;
+    pointer_valid = same_screen;
+}
+
+/**
+ * Feed an event to the pointer and stacking mirrors
+ */
+void mocha_pointer_track_event(const XEvent *e) {
+    int i;
+    switch(e->type) {
+        case MotionNotify:
+            set_pointer(e->xmotion.x_root, e->xmotion.y_root,
+                        e->xmotion.same_screen);
+            break;
+        case EnterNotify:
+        case LeaveNotify:
+            set_pointer(e->xcrossing.x_root, e->xcrossing.y_root,
+                        e->xcrossing.same_screen);
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            set_pointer(e->xbutton.x_root, e->xbutton.y_root,
+                        e->xbutton.same_screen);
+            break;
+        case KeyPress:
+        case KeyRelease:
+            set_pointer(e->xkey.x_root, e->xkey.y_root, e->xkey.same_screen);
+            break;
+
+        case CreateNotify: {
+            const XCreateWindowEvent *c = &e->xcreatewindow;
+            if(c->parent != root || stack_find(c->window) >= 0) break;
+            StackEntry *s = stack_insert(stack_len, c->window);
+            if(!s) break;
+            s->x = c->x;
+            s->y = c->y;
+            s->w = c->width;
+            s->h = c->height;
+            s->border = c->border_width;
+            break;
+        }
+        case DestroyNotify:
+            if((i = stack_find(e->xdestroywindow.window)) >= 0)
+                stack_remove(i);
+            break;
+        case ReparentNotify:
+            i = stack_find(e->xreparent.window);
+            if(e->xreparent.parent == root) {
+                if(i < 0) stack_valid = 0;
+            } else if(i >= 0) {
+                stack_remove(i);
+            }
+            break;
+        case ConfigureNotify: {
+            const XConfigureEvent *c = &e->xconfigure;
+            if((i = stack_find(c->window)) < 0) break;
+            stack[i].x = c->x;
+            stack[i].y = c->y;
+            stack[i].w = c->width;
+            stack[i].h = c->height;
+            stack[i].border = c->border_width;
+            stack_restack(i, c->above);
+            break;
+        }
+        case CirculateNotify:
+            if((i = stack_find(e->xcirculate.window)) < 0) break;
+            if(e->xcirculate.place == PlaceOnTop) {
+                StackEntry entry = stack[i];
+                stack_remove(i);
+                stack[stack_len++] = entry;
+            } else {
+                stack_restack(i, None);
+            }
+            break;
+        case MapNotify:
+            if((i = stack_find(e->xmap.window)) >= 0) stack[i].mapped = 1;
+            break;
+        case UnmapNotify:
+            if((i = stack_find(e->xunmap.window)) >= 0) stack[i].mapped = 0;
+            break;
+    }
+}
+
+/**
+ * Forget everything, for when events were consumed elsewhere (the
+ * launcher runs its own event loop)
+ */
+void mocha_pointer_invalidate() {
+    pointer_valid = 0;
+    stack_valid = 0;
+}
+
+/**
+ * Top-level window under the pointer, or None. Answered from the mirrors
+ * and only asks the server when they are stale
+ */
+Window mocha_pointer_window() {
+    if(!stack_valid) stack_sync();
+
+    if(!pointer_valid) {
+        Window root_ret, child;
+        int rx, ry, wx, wy;
+        unsigned int mask;
+        mocha_stats_roundtrip();
+        if(!XQueryPointer(dpy, root, &root_ret, &child, &rx, &ry, &wx, &wy,
+                          &mask))
+            return None;
+        set_pointer(rx, ry, True);
+        return child;
+    }
+
+    for(int i = stack_len - 1; i >= 0; i--) {
+        const StackEntry *s = &stack[i];
+        if(!s->mapped) continue;
+        if(pointer_x >= s->x && pointer_x < s->x + s->w + 2 * s->border &&
+           pointer_y >= s->y && pointer_y < s->y + s->h + 2 * s->border)
+            return s->window;
+    }
+    return None;
+}
+
+/**
+ * Root coordinates of the pointer, from the last input event when known
+ */
+void mocha_pointer_position(int *x, int *y) {
+    if(!pointer_valid) {
+        Window root_ret, child;
+        int wx, wy;
+        unsigned int mask;
+        mocha_stats_roundtrip();
+        if(XQueryPointer(dpy, root, &root_ret, &child, x, y, &wx, &wy, &mask))
+            set_pointer(*x, *y, True);
+        else
+            *x = *y = 0;
+        return;
+    }
+    *x = pointer_x;
+    *y = pointer_y;
+}
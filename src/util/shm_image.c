@@ -0,0 +1,240 @@
+#include "util/shm_image.h"
+
+#include <X11/Xutil.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "main.h"
+#include "util/stats.h"
+
+/*
+ * Image uploads without the protocol copy. Pixels live in a SysV shared
+ * segment the server attaches to, so a put is one small request and the
+ * server reads straight from our memory. Puts ask for a completion event
+ * and are counted until it arrives, drawing waits for them so nothing
+ * overwrites pixels the server has not read yet. Callers draw first and
+ * put afterwards, so a put never waits for the one before. Without
+ * MIT-SHM, or on a remote display, the same image goes out with
+ * XPutImage.
+ *
+ * Only 32 bit pixels in cairo's layout are handled, that is depth 24 or
+ * 32 TrueColor visuals with 8 bit channels in xRGB order.
+ */
+
+#define MAX_SHM_IMAGES 8
+
+static int shm_checked = 0;
+static bool shm_ok = false;
+static int completion_event = -1;
+/* Images with a segment, to match completion events */
+static ShmImage *live[MAX_SHM_IMAGES];
+
+static bool host_lsb_first() {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one == 1;
+}
+
+/**
+ * Whether puts can go through shared memory on this display
+ */
+bool mocha_shm_available() {
+    if(shm_checked) return shm_ok;
+    shm_checked = 1;
+    int major, minor;
+    Bool pixmaps;
+    shm_ok = XShmQueryVersion(dpy, &major, &minor, &pixmaps) &&
+             (ImageByteOrder(dpy) == LSBFirst) == host_lsb_first();
+    if(shm_ok) completion_event = XShmGetEventBase(dpy) + ShmCompletion;
+    mocha_log("MIT-SHM %s", shm_ok ? "available" : "not available");
+    return shm_ok;
+}
+
+/**
+ * Send images created from now on through XPutImage, for comparing the
+ * two paths
+ */
+void mocha_shm_disable() {
+    shm_checked = 1;
+    shm_ok = false;
+}
+
+static bool visual_matches(const Visual *visual, int depth) {
+    return (depth == 24 || depth == 32) && visual->red_mask == 0xff0000 &&
+           visual->green_mask == 0xff00 && visual->blue_mask == 0xff;
+}
+
+static bool track(ShmImage *img) {
+    for(int i = 0; i < MAX_SHM_IMAGES; i++) {
+        if(live[i]) continue;
+        live[i] = img;
+        return true;
+    }
+    return false;
+}
+
+static void untrack(ShmImage *img) {
+    for(int i = 0; i < MAX_SHM_IMAGES; i++)
+        if(live[i] == img) live[i] = NULL;
+}
+
+static void drop_shared(ShmImage *img) {
+    if(img->shm.shmaddr) shmdt(img->shm.shmaddr);
+    if(img->ximage) {
+        img->ximage->data = NULL;
+        XDestroyImage(img->ximage);
+    }
+    untrack(img);
+    img->ximage = NULL;
+    img->shm.shmaddr = NULL;
+}
+
+/**
+ * Put the pixels in a segment shared with the server, false if the server
+ * cannot attach it (remote display, out of segments)
+ */
+static bool attach_shared(ShmImage *img, Visual *visual, int depth) {
+    if(!mocha_shm_available() || !track(img)) return false;
+    img->ximage = XShmCreateImage(dpy, visual, depth, ZPixmap, NULL,
+                                  &img->shm, img->width, img->height);
+    if(!img->ximage) {
+        drop_shared(img);
+        return false;
+    }
+    img->shm.shmid = shmget(IPC_PRIVATE,
+                            (size_t)img->ximage->bytes_per_line * img->height,
+                            IPC_CREAT | 0600);
+    void *addr = img->shm.shmid < 0 ? (void *)-1
+                                     : shmat(img->shm.shmid, NULL, 0);
+    if(addr == (void *)-1) {
+        if(img->shm.shmid >= 0) shmctl(img->shm.shmid, IPC_RMID, NULL);
+        drop_shared(img);
+        return false;
+    }
+    img->shm.shmaddr = img->ximage->data = addr;
+    img->shm.readOnly = True;
+
+    mocha_trap_errors();
+    XShmAttach(dpy, &img->shm);
+    bool attached = mocha_untrap_errors() == 0;
+    /* Freed once both sides detach, even if we crash */
+    shmctl(img->shm.shmid, IPC_RMID, NULL);
+    if(!attached) {
+        /* Remote display, do not try again */
+        shm_ok = false;
+        drop_shared(img);
+        return false;
+    }
+    img->shared = true;
+    return true;
+}
+
+static bool create_unshared(ShmImage *img, Visual *visual, int depth) {
+    char *data = malloc((size_t)img->width * 4 * img->height);
+    if(!data) return false;
+    img->ximage = XCreateImage(dpy, visual, depth, ZPixmap, 0, data,
+                               img->width, img->height, 32, img->width * 4);
+    if(!img->ximage) {
+        free(data);
+        return false;
+    }
+    /* Xlib swaps on the way out if the server wants the other order */
+    img->ximage->byte_order = host_lsb_first() ? LSBFirst : MSBFirst;
+    return true;
+}
+
+/**
+ * Make a width x height image for drawables of the given visual and
+ * depth, false if the visual is not one cairo can draw into directly
+ */
+bool mocha_shm_image_create(ShmImage *img, Visual *visual, int depth,
+                            int width, int height) {
+    *img = (ShmImage){0};
+    if(!visual_matches(visual, depth) || width <= 0 || height <= 0)
+        return false;
+    img->width = width;
+    img->height = height;
+    if(!attach_shared(img, visual, depth) &&
+       !create_unshared(img, visual, depth))
+        return false;
+
+    XImage *xi = img->ximage;
+    img->surface = cairo_image_surface_create_for_data(
+        (unsigned char *)xi->data,
+        depth == 32 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24, width, height,
+        xi->bytes_per_line);
+    if(xi->bits_per_pixel != 32 ||
+       cairo_surface_status(img->surface) != CAIRO_STATUS_SUCCESS) {
+        mocha_shm_image_destroy(img);
+        return false;
+    }
+    return true;
+}
+
+void mocha_shm_image_destroy(ShmImage *img) {
+    if(img->surface) cairo_surface_destroy(img->surface);
+    if(img->shared) {
+        mocha_shm_image_wait(img);
+        XShmDetach(dpy, &img->shm);
+        drop_shared(img);
+    }
+    if(img->ximage) XDestroyImage(img->ximage);
+    *img = (ShmImage){0};
+}
+
+static Bool is_completion(Display *d, XEvent *e, XPointer arg) {
+    const ShmImage *img = (const ShmImage *)arg;
+    return e->type == completion_event &&
+           ((XShmCompletionEvent *)e)->shmseg == img->shm.shmseg;
+}
+
+/**
+ * Block until the server has read every put, call before drawing
+ */
+void mocha_shm_image_wait(ShmImage *img) {
+    if(img->pending > 0) mocha_stats_roundtrip();
+    while(img->pending > 0) {
+        XEvent e;
+        XIfEvent(dpy, &e, is_completion, (XPointer)img);
+        img->pending--;
+    }
+}
+
+/**
+ * Copy a rectangle of the image to the same place in a drawable
+ */
+void mocha_shm_image_put(ShmImage *img, Drawable d, GC gc, int x, int y,
+                         int w, int h) {
+    /* Expose rectangles may reach past the image */
+    if(x < 0) w += x, x = 0;
+    if(y < 0) h += y, y = 0;
+    if(x + w > img->width) w = img->width - x;
+    if(y + h > img->height) h = img->height - y;
+    if(w <= 0 || h <= 0) return;
+
+    cairo_surface_flush(img->surface);
+    size_t bytes = (size_t)w * h * 4;
+    if(img->shared) {
+        XShmPutImage(dpy, d, gc, img->ximage, x, y, x, y, w, h, True);
+        img->pending++;
+        mocha_stats.shm_puts++;
+        mocha_stats.shm_put_bytes += bytes;
+    } else {
+        XPutImage(dpy, d, gc, img->ximage, x, y, x, y, w, h);
+        mocha_stats.image_puts++;
+        mocha_stats.image_put_bytes += bytes;
+    }
+}
+
+/**
+ * Handle MIT-SHM completion events, returns 1 if e was one
+ */
+int mocha_shm_image_handle_event(XEvent *e) {
+    if(completion_event < 0 || e->type != completion_event) return 0;
+    const XShmCompletionEvent *c = (const XShmCompletionEvent *)e;
+    for(int i = 0; i < MAX_SHM_IMAGES; i++)
+        if(live[i] && live[i]->shm.shmseg == c->shmseg && live[i]->pending)
+            live[i]->pending--;
+    return 1;
+}
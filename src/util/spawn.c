@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+#include "util/spawn.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "main.h"
+
+#define MAX_SPAWN_ARGS 64
+
+extern char **environ;
+
+/* Children we spawned and still have to reap */
+static pid_t *children = NULL;
+static int num_children = 0;
+static int children_cap = 0;
+
+/**
+ * Spawn attributes for children. The WM blocks the signals it reads
+ * through a signalfd and that mask would survive exec, so children start
+ * with an empty one. Detached children get their own session
+ */
+void mocha_spawn_attr_init(posix_spawnattr_t *attr, int detach) {
+    sigset_t none;
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    sigemptyset(&none);
+    posix_spawnattr_init(attr);
+    posix_spawnattr_setsigmask(attr, &none);
+#ifdef POSIX_SPAWN_SETSID
+    if(detach) flags |= POSIX_SPAWN_SETSID;
+#endif
+    posix_spawnattr_setflags(attr, flags);
+}
+
+/* Anything the shell would have to interpret */
+static int needs_shell(const char *cmd) {
+    return strpbrk(cmd, "|&;<>()$`*?[]{}~#\n") != NULL;
+}
+
+/**
+ * Split a command into argv in place, honoring quotes and backslashes.
+ * Returns the number of arguments or -1 if there are too many
+ */
+static int split_args(char *buf, char **argv) {
+    int argc = 0;
+    char *in = buf, *out = buf;
+
+    while(*in) {
+        while(*in == ' ' || *in == '\t') in++;
+        if(!*in) break;
+        if(argc == MAX_SPAWN_ARGS - 1) return -1;
+        argv[argc++] = out;
+
+        char quote = 0;
+        while(*in && (quote || (*in != ' ' && *in != '\t'))) {
+            if(quote && *in == quote) {
+                quote = 0;
+                in++;
+            } else if(!quote && (*in == '\'' || *in == '"')) {
+                quote = *in++;
+            } else if(*in == '\\' && quote != '\'' && in[1]) {
+                in++;
+                *out++ = *in++;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        if(*in) in++;
+        *out++ = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+/**
+ * Make room to track one more child. Done before spawning, a child we
+ * could not track would never be reaped
+ */
+static int reserve_child() {
+    if(num_children < children_cap) return 1;
+    int cap = children_cap ? children_cap * 2 : 16;
+    pid_t *grown = realloc(children, cap * sizeof(*grown));
+    if(!grown) return 0;
+    children = grown;
+    children_cap = cap;
+    return 1;
+}
+
+/**
+ * Start a command in the background without blocking the event loop.
+ * Plain commands are exec'd directly, anything needing the shell goes
+ * through /bin/sh -c. A trailing '&' is accepted and ignored
+ */
+pid_t mocha_spawn(const char *cmd) {
+    char buf[1024];
+    char *argv[MAX_SPAWN_ARGS];
+
+    if(!cmd) return -1;
+    while(*cmd == ' ') cmd++;
+    size_t len = strlen(cmd);
+    if(len >= sizeof(buf)) {
+        mocha_log("Spawn] Command too long: %.64s...", cmd);
+        return -1;
+    }
+    memcpy(buf, cmd, len + 1);
+    while(len > 0 && (buf[len - 1] == ' ' || buf[len - 1] == '&'))
+        buf[--len] = '\0';
+    if(len == 0) return -1;
+
+    int argc = needs_shell(buf) ? -1 : split_args(buf, argv);
+    if(argc <= 0) {
+        memcpy(buf, cmd, len);
+        buf[len] = '\0';
+        argv[0] = "sh";
+        argv[1] = "-c";
+        argv[2] = buf;
+        argv[3] = NULL;
+    }
+
+    if(!reserve_child()) {
+        mocha_log("Spawn] Out of memory, not starting '%s'", cmd);
+        return -1;
+    }
+
+    posix_spawnattr_t attr;
+    mocha_spawn_attr_init(&attr, 1);
+    pid_t pid;
+    int err;
+    if(argc <= 0)
+        err = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+    else
+        err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+
+    if(err != 0) {
+        mocha_log("Spawn] Failed to start '%s': %s", cmd, strerror(err));
+        return -1;
+    }
+    children[num_children++] = pid;
+    return pid;
+}
+
+/**
+ * Reap finished children, called when the signalfd reports SIGCHLD.
+ * Only our own children are waited for so blocking helpers like
+ * mocha_system() keep their exit status
+ */
+void mocha_spawn_reap() {
+    for(int i = 0; i < num_children;) {
+        pid_t r = waitpid(children[i], NULL, WNOHANG);
+        if(r == children[i] || (r < 0 && errno == ECHILD)) {
+            children[i] = children[--num_children];
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#include "util/stats.h"
+
+#include <time.h>
+
+#include "main.h"
+
+struct MochaStats mocha_stats = {0};
+
+static time_t start_time;
+static time_t layout_second;
+static unsigned long layout_passes_this_second;
+
+static time_t monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+void mocha_stats_init() { start_time = monotonic_seconds(); }
+
+double mocha_stats_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char *event_names[LASTEvent] = {
+    [0] = "(idle)",
+    [KeyPress] = "KeyPress",
+    [KeyRelease] = "KeyRelease",
+    [ButtonPress] = "ButtonPress",
+    [ButtonRelease] = "ButtonRelease",
+    [MotionNotify] = "MotionNotify",
+    [EnterNotify] = "EnterNotify",
+    [LeaveNotify] = "LeaveNotify",
+    [FocusIn] = "FocusIn",
+    [FocusOut] = "FocusOut",
+    [Expose] = "Expose",
+    [CreateNotify] = "CreateNotify",
+    [DestroyNotify] = "DestroyNotify",
+    [UnmapNotify] = "UnmapNotify",
+    [MapNotify] = "MapNotify",
+    [MapRequest] = "MapRequest",
+    [ReparentNotify] = "ReparentNotify",
+    [ConfigureNotify] = "ConfigureNotify",
+    [ConfigureRequest] = "ConfigureRequest",
+    [PropertyNotify] = "PropertyNotify",
+    [ClientMessage] = "ClientMessage",
+};
+
+/**
+ * Mark the start of dispatching an event of the given type
+ */
+void mocha_stats_begin_event(int type) {
+    if(type < 0 || type >= LASTEvent) type = 0;
+    mocha_stats.current_event = type;
+    if(mocha_stats.debug_roundtrips) mocha_stats.events[type]++;
+}
+
+/**
+ * Count a synchronous server round trip against the current event
+ */
+void mocha_stats_roundtrip() {
+    if(mocha_stats.debug_roundtrips)
+        mocha_stats.roundtrips[mocha_stats.current_event]++;
+}
+
+/**
+ * Record one layout pass
+ */
+void mocha_stats_layout_pass(int windows_touched) {
+    time_t now = monotonic_seconds();
+    if(now != layout_second) {
+        layout_second = now;
+        layout_passes_this_second = 0;
+    }
+    if(++layout_passes_this_second > mocha_stats.layout_passes_peak)
+        mocha_stats.layout_passes_peak = layout_passes_this_second;
+    mocha_stats.layout_passes++;
+    mocha_stats.layout_windows_touched += windows_touched;
+}
+
+/**
+ * Record how long an opened launcher took to show its first frame
+ */
+void mocha_stats_launcher_frame(double first_frame_ms) {
+    mocha_stats.launcher_opens++;
+    mocha_stats.launcher_first_frame_ms = first_frame_ms;
+    mocha_stats.launcher_first_frame_total_ms += first_frame_ms;
+    if(first_frame_ms > mocha_stats.launcher_first_frame_max_ms)
+        mocha_stats.launcher_first_frame_max_ms = first_frame_ms;
+}
+
+/**
+ * Record how long the launcher took until every visible icon was drawn
+ */
+void mocha_stats_launcher_filled(double filled_ms) {
+    mocha_stats.launcher_filled_ms = filled_ms;
+}
+
+/**
+ * Print all runtime counters
+ */
+void mocha_stats_log() {
+    mocha_log("Stats] motion: %lu events, %lu coalesced",
+              mocha_stats.motion_events, mocha_stats.motion_coalesced);
+    mocha_log("Stats] batches: %lu", mocha_stats.batches);
+
+    time_t uptime = monotonic_seconds() - start_time;
+    if(uptime < 1) uptime = 1;
+    unsigned long passes = mocha_stats.layout_passes;
+    mocha_log(
+        "Stats] layout: %lu passes (%.2f/s avg, %lu/s peak), %.2f windows "
+        "touched per pass, %lu retiles coalesced",
+        passes, (double)passes / uptime, mocha_stats.layout_passes_peak,
+        passes ? (double)mocha_stats.layout_windows_touched / passes : 0.0,
+        mocha_stats.retiles_coalesced);
+    if(mocha_stats.launcher_opens)
+        mocha_log("Stats] launcher: %lu opens, first frame %.1f ms last, "
+                  "%.1f ms avg, %.1f ms max, icons filled %.1f ms last",
+                  mocha_stats.launcher_opens,
+                  mocha_stats.launcher_first_frame_ms,
+                  mocha_stats.launcher_first_frame_total_ms /
+                      mocha_stats.launcher_opens,
+                  mocha_stats.launcher_first_frame_max_ms,
+                  mocha_stats.launcher_filled_ms);
+    if(mocha_stats.shm_puts || mocha_stats.image_puts)
+        mocha_log("Stats] image uploads: %lu shared (%lu KiB), %lu over the "
+                  "socket (%lu KiB)",
+                  mocha_stats.shm_puts, mocha_stats.shm_put_bytes / 1024,
+                  mocha_stats.image_puts, mocha_stats.image_put_bytes / 1024);
+
+    if(!mocha_stats.debug_roundtrips) return;
+    for(int i = 0; i < LASTEvent; i++) {
+        if(!mocha_stats.events[i] && !mocha_stats.roundtrips[i]) continue;
+        const char *name = event_names[i] ? event_names[i] : "(other)";
+        double per_event = mocha_stats.events[i]
+                               ? (double)mocha_stats.roundtrips[i] /
+                                     mocha_stats.events[i]
+                               : 0.0;
+        mocha_log("Stats] %-16s %8lu events %8lu round trips (%.2f/event)",
+                  name, mocha_stats.events[i], mocha_stats.roundtrips[i],
+                  per_event);
+    }
+}
@@ -0,0 +1,300 @@
+#include "util/wallpaper.h"
+
+#include <cairo/cairo-xlib.h>
+#include <cairo/cairo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lib/stb_image.h"
+#include "main.h"
+#include "util/loop.h"
+#include "util/pixel.h"
+#include "util/shm_image.h"
+#include "util/stats.h"
+
+/*
+ * Root background scaled to the screen. The scaled pixels are kept in the
+ * cache directory, keyed by the image path, its mtime and size, the screen
+ * size and the scaling mode, so a warm start maps them and uploads them as
+ * they are. A cold start shows a plain background and decodes on a thread
+ * while the WM is already running. Either way the pixels reach the root
+ * pixmap as one image upload, through shared memory when the server can.
+ *
+ * Layout: header, padding up to WALLPAPER_DATA_OFFSET, then RGB24 rows of
+ * header.stride bytes.
+ */
+
+#define WALLPAPER_MAGIC "MOCHAWP1"
+#define WALLPAPER_DATA_OFFSET 4096
+
+/* Everything but the magic doubles as the cache key */
+typedef struct {
+    char magic[8];
+    int64_t mtime_sec, mtime_nsec;
+    int64_t file_size;
+    int32_t width, height;
+    int32_t stride;
+    char mode[32];
+    char path[1024];
+} WallpaperHeader;
+
+_Static_assert(sizeof(WallpaperHeader) <= WALLPAPER_DATA_OFFSET,
+               "wallpaper header must fit before the pixels");
+
+static Pixmap pixmap = None;
+/* Upload buffer the decode renders into, no surface if not available */
+static ShmImage image;
+static WallpaperHeader key;
+static char cache_file[1100];
+
+/* Background decode, the result is picked up after joining the thread */
+static pthread_t load_thread;
+static cairo_surface_t *loaded;
+static double load_started;
+
+/**
+ * Fill in the key for an image, false if the file cannot be read
+ */
+static bool make_key(const char *path, const char *mode, int width,
+                     int height, WallpaperHeader *out) {
+    struct stat st;
+    if(stat(path, &st) < 0) return false;
+    memset(out, 0, sizeof(*out));
+    memcpy(out->magic, WALLPAPER_MAGIC, sizeof(out->magic));
+    out->mtime_sec = st.st_mtim.tv_sec;
+    out->mtime_nsec = st.st_mtim.tv_nsec;
+    out->file_size = st.st_size;
+    out->width = width;
+    out->height = height;
+    out->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, width);
+    strncpy(out->mode, mode, sizeof(out->mode) - 1);
+    strncpy(out->path, path, sizeof(out->path) - 1);
+    return true;
+}
+
+/**
+ * Decode the image and scale it to the screen, NULL if it cannot be
+ * decoded. Safe to run off the main thread
+ */
+static cairo_surface_t *render_wallpaper(const WallpaperHeader *k) {
+    int img_w, img_h, img_channels;
+    stbi_uc *data = stbi_load(k->path, &img_w, &img_h, &img_channels, 4);
+    if(!data) return NULL;
+    mocha_pixel_rgba_to_argb32(data, (size_t)img_w * img_h);
+    cairo_surface_t *img_surface = cairo_image_surface_create_for_data(
+        data, CAIRO_FORMAT_ARGB32, img_w, img_h, img_w * 4);
+
+    cairo_surface_t *out =
+        image.surface ? cairo_surface_reference(image.surface)
+                      : cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                                                   k->width, k->height);
+    cairo_t *cr = cairo_create(out);
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+    if(strcmp(k->mode, "stretch_fit") == 0) {
+        cairo_scale(cr, (double)k->width / img_w, (double)k->height / img_h);
+    } else {
+        double sx = (double)k->width / img_w;
+        double sy = (double)k->height / img_h;
+        double scale = sx < sy ? sx : sy;
+        cairo_translate(cr, (k->width - img_w * scale) / 2,
+                        (k->height - img_h * scale) / 2);
+        cairo_scale(cr, scale, scale);
+    }
+    cairo_set_source_surface(cr, img_surface, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    cairo_surface_destroy(img_surface);
+    stbi_image_free(data);
+
+    cairo_surface_flush(out);
+    if(cairo_surface_status(out) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(out);
+        return NULL;
+    }
+    return out;
+}
+
+/**
+ * Store scaled pixels, atomically replacing the previous wallpaper
+ */
+static void save_wallpaper(const char *file, const WallpaperHeader *k,
+                           cairo_surface_t *pixels) {
+    char tmp[1200];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", file, (int)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if(!f) return;
+
+    static const char padding[WALLPAPER_DATA_OFFSET];
+    fwrite(k, sizeof(*k), 1, f);
+    fwrite(padding, 1, WALLPAPER_DATA_OFFSET - sizeof(*k), f);
+    /* The upload buffer may pad its rows differently */
+    const uint8_t *row = cairo_image_surface_get_data(pixels);
+    int stride = cairo_image_surface_get_stride(pixels);
+    for(int y = 0; y < k->height; y++, row += stride)
+        fwrite(row, k->stride, 1, f);
+    int failed = ferror(f);
+    if(fclose(f) != 0) failed = 1;
+    if(failed || rename(tmp, file) < 0) {
+        mocha_log("Wallpaper: failed to write %s", file);
+        unlink(tmp);
+    }
+}
+
+/**
+ * Copy scaled pixels onto the root background pixmap and show them
+ */
+static void show_wallpaper(cairo_surface_t *pixels) {
+    if(image.surface) {
+        if(pixels != image.surface) {
+            cairo_t *cr = cairo_create(image.surface);
+            cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+            cairo_set_source_surface(cr, pixels, 0, 0);
+            cairo_paint(cr);
+            cairo_destroy(cr);
+        }
+        GC gc = XCreateGC(dpy, pixmap, 0, NULL);
+        mocha_shm_image_put(&image, pixmap, gc, 0, 0, key.width, key.height);
+        XFreeGC(dpy, gc);
+    } else {
+        cairo_surface_t *target =
+            cairo_xlib_surface_create(dpy, pixmap, DefaultVisual(dpy, screen),
+                                      key.width, key.height);
+        cairo_t *cr = cairo_create(target);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(cr, pixels, 0, 0);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(target);
+        cairo_surface_destroy(target);
+    }
+
+    XSetWindowBackgroundPixmap(dpy, root, pixmap);
+    XClearWindow(dpy, root);
+}
+
+/**
+ * Show the stored pixels if they were made for the current key
+ */
+static bool show_cached() {
+    int fd = open(cache_file, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+    size_t size = WALLPAPER_DATA_OFFSET + (size_t)key.stride * key.height;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size != size) {
+        close(fd);
+        return false;
+    }
+    uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return false;
+
+    bool hit = memcmp(map, &key, sizeof(key)) == 0;
+    if(hit) {
+        /* cairo only reads from a source surface */
+        cairo_surface_t *pixels = cairo_image_surface_create_for_data(
+            map + WALLPAPER_DATA_OFFSET, CAIRO_FORMAT_RGB24, key.width,
+            key.height, key.stride);
+        show_wallpaper(pixels);
+        cairo_surface_destroy(pixels);
+    }
+    munmap(map, size);
+    return hit;
+}
+
+static void *load_worker(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    loaded = render_wallpaper(&key);
+    if(loaded && cache_file[0]) save_wallpaper(cache_file, &key, loaded);
+    uint64_t one = 1;
+    if(write(fd, &one, sizeof(one)) < 0) perror("wallpaper write");
+    return NULL;
+}
+
+static void set_plain_background() {
+    XSetWindowBackground(dpy, root, 0x000000);
+    XClearWindow(dpy, root);
+}
+
+/**
+ * Show the wallpaper at path scaled to width x height, mode is
+ * "stretch_fit" or anything else to keep the aspect ratio. Returns an
+ * eventfd for mocha_wallpaper_handle_loaded() if the image is being
+ * decoded in the background, -1 if there is nothing left to do
+ */
+int mocha_wallpaper_init(const char *path, const char *mode, int width,
+                         int height) {
+    double started = mocha_stats_now_ms();
+    if(!mode[0]) mode = "stretch_fit";
+    if(!make_key(path, mode, width, height, &key)) {
+        mocha_log("Failed to load wallpaper image: %s", path);
+        set_plain_background();
+        return -1;
+    }
+    if(!mocha_cache_path("wallpaper", cache_file, sizeof(cache_file)))
+        cache_file[0] = '\0';
+
+    int depth = DefaultDepth(dpy, screen);
+    pixmap = XCreatePixmap(dpy, root, width, height, depth);
+    mocha_shm_image_create(&image, DefaultVisual(dpy, screen), depth, width,
+                           height);
+    if(cache_file[0] && show_cached()) {
+        mocha_shm_image_destroy(&image);
+        mocha_log("Wallpaper: %dx%d from cache in %.1f ms", width, height,
+                  mocha_stats_now_ms() - started);
+        return -1;
+    }
+
+    /* Plain background until the decode is done */
+    set_plain_background();
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd >= 0 && pthread_create(&load_thread, NULL, load_worker,
+                                 (void *)(intptr_t)fd) == 0) {
+        load_started = started;
+        return fd;
+    }
+    if(fd >= 0) close(fd);
+
+    mocha_log("Failed to start wallpaper loader, loading in place");
+    loaded = render_wallpaper(&key);
+    if(loaded && cache_file[0]) save_wallpaper(cache_file, &key, loaded);
+    mocha_wallpaper_handle_loaded(-1, NULL);
+    return -1;
+}
+
+/**
+ * Main loop callback for the loader's eventfd, which is only used once
+ */
+void mocha_wallpaper_handle_loaded(int fd, void *data) {
+    if(fd >= 0) {
+        uint64_t count;
+        if(read(fd, &count, sizeof(count)) < 0) return;
+        pthread_join(load_thread, NULL);
+        mocha_loop_remove_fd(fd);
+        close(fd);
+        mocha_log("Wallpaper: %dx%d decoded in %.1f ms", key.width,
+                  key.height, mocha_stats_now_ms() - load_started);
+    }
+    if(loaded) {
+        show_wallpaper(loaded);
+        cairo_surface_destroy(loaded);
+        loaded = NULL;
+    } else {
+        mocha_log("Failed to load wallpaper image: %s", key.path);
+    }
+    mocha_shm_image_destroy(&image);
+}
+
+void mocha_wallpaper_free() {
+    if(pixmap != None) XFreePixmap(dpy, pixmap);
+    pixmap = None;
+}
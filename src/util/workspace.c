@@ -0,0 +1,127 @@
+#include "util/workspace.h"
+
+#include "main.h"
+#include "util/monitor.h"
+
+/*
+ * Each workspace owns an intrusive list of its clients, so a switch only
+ * walks the clients being hidden and shown, never the whole table.
+ */
+
+Workspace workspaces[MAX_WORKSPACES];
+int num_workspaces = 1;
+int current_workspace = 0;
+
+static int is_attached(const Client *c) {
+    return c->ws_prev || workspaces[c->workspace].first == c;
+}
+
+void mocha_workspace_init(int count) {
+    if(count < 1) count = 1;
+    if(count > MAX_WORKSPACES) count = MAX_WORKSPACES;
+    num_workspaces = count;
+}
+
+/**
+ * Append a client to a workspace, does nothing if it is already on one
+ */
+void mocha_workspace_attach(Client *c, int ws) {
+    if(is_attached(c)) return;
+    Workspace *w = &workspaces[ws];
+    c->workspace = ws;
+    c->ws_prev = w->last;
+    c->ws_next = NULL;
+    if(w->last)
+        w->last->ws_next = c;
+    else
+        w->first = c;
+    w->last = c;
+    w->count++;
+}
+
+void mocha_workspace_detach(Client *c) {
+    if(!is_attached(c)) return;
+    Workspace *w = &workspaces[c->workspace];
+    if(c->ws_prev)
+        c->ws_prev->ws_next = c->ws_next;
+    else
+        w->first = c->ws_next;
+    if(c->ws_next)
+        c->ws_next->ws_prev = c->ws_prev;
+    else
+        w->last = c->ws_prev;
+    c->ws_prev = c->ws_next = NULL;
+    w->count--;
+}
+
+/**
+ * Show another workspace. The maps and unmaps go out as one batch under a
+ * server grab so nobody sees a half switched screen, and the clients come
+ * back at their cached geometry
+ */
+void mocha_workspace_switch(int ws) {
+    if(ws < 0 || ws >= num_workspaces || ws == current_workspace) return;
+    Workspace *from = &workspaces[current_workspace];
+    Workspace *to = &workspaces[ws];
+
+    /* Retiles still pending for the old workspace wait until it is shown */
+    for(int i = 0; i < num_monitors; i++) {
+        if(!monitors[i].dirty) continue;
+        from->dirty |= 1u << i;
+        monitors[i].dirty = 0;
+    }
+
+    /* Map first, so the old windows uncover the new ones rather than the
+       root background */
+    XGrabServer(dpy);
+    for(Client *c = to->first; c; c = c->ws_next)
+        if(!c->state.is_minimized) XMapWindow(dpy, c->window);
+    for(Client *c = from->first; c; c = c->ws_next)
+        if(!c->state.is_minimized) XUnmapWindow(dpy, c->window);
+    XUngrabServer(dpy);
+
+    current_workspace = ws;
+    for(int i = 0; i < num_monitors; i++)
+        if(to->dirty & (1u << i)) mocha_request_retile_monitor(i);
+    to->dirty = 0;
+}
+
+/**
+ * Send a client to another workspace, hiding it if that one is not shown
+ */
+void mocha_workspace_move_client(Client *c, int ws) {
+    if(ws < 0 || ws >= num_workspaces) return;
+    if(is_attached(c)) {
+        if(c->workspace == ws) return;
+        mocha_request_retile_client(c);
+        mocha_workspace_detach(c);
+        if(c->workspace == current_workspace && !c->state.is_minimized)
+            XUnmapWindow(dpy, c->window);
+    }
+    mocha_workspace_attach(c, ws);
+    mocha_request_retile_client(c);
+}
+
+/**
+ * Mark monitors as needing a layout pass on every hidden workspace, for
+ * changes that affect all of them (output resized, layout switched)
+ */
+void mocha_workspace_invalidate(unsigned int monitor_mask) {
+    for(int i = 0; i < num_workspaces; i++)
+        if(i != current_workspace) workspaces[i].dirty |= monitor_mask;
+}
+
+/**
+ * Move every workspace's pending passes to the new monitor indices after
+ * the outputs changed. old_to_new is -1 for monitors that went away, their
+ * clients are rehomed and retiled anyway
+ */
+void mocha_workspace_remap_monitors(const int *old_to_new, int old_count) {
+    for(int i = 0; i < num_workspaces; i++) {
+        unsigned int dirty = 0;
+        for(int j = 0; j < old_count; j++)
+            if((workspaces[i].dirty & (1u << j)) && old_to_new[j] >= 0)
+                dirty |= 1u << old_to_new[j];
+        workspaces[i].dirty = dirty;
+    }
+}
@@ -0,0 +1,164 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util/client.h"
+
+/*
+ * Cost per lookup, insert and remove of the client registry against the
+ * arrays it replaced, at monitoring wall scale. Best of several runs, not
+ * run by ctest.
+ */
+
+#define MAX_WINDOWS 8192
+#define RUNS 10
+/* Lookups are much more frequent than the other two, every event does one */
+#define LOOKUP_PASSES 20
+
+typedef struct {
+    const char *name;
+    void (*add)(Window w);
+    void (*remove)(Window w);
+    bool (*find)(Window w);
+} Registry;
+
+typedef struct {
+    double lookup, miss, insert, remove;
+} Timings;
+
+/* client_table.c logs when it runs out of memory */
+void mocha_log(const char *fmt, ...) {}
+
+/*
+ * The old registry: state indexed by w % MAX_CLIENTS and a managed array
+ * scanned by is_managed_client(). The array is sized for the benchmark,
+ * the real one stopped at MAX_CLIENTS windows.
+ */
+
+#define OLD_MAX_CLIENTS 256
+
+static ClientState old_states[OLD_MAX_CLIENTS];
+static Window old_managed[MAX_WINDOWS];
+static int old_count = 0;
+
+static void old_add(Window w) {
+    if(old_count < MAX_WINDOWS) old_managed[old_count++] = w;
+}
+
+static void old_remove(Window w) {
+    for(int i = 0; i < old_count; i++) {
+        if(old_managed[i] == w) {
+            for(int j = i; j < old_count - 1; j++)
+                old_managed[j] = old_managed[j + 1];
+            old_count--;
+            break;
+        }
+    }
+}
+
+static bool old_find(Window w) {
+    for(int i = 0; i < old_count; i++)
+        if(old_managed[i] == w)
+            return old_states[w % OLD_MAX_CLIENTS].is_minimized >= 0;
+    return false;
+}
+
+static void table_add(Window w) { mocha_client_add(w); }
+
+static void table_remove(Window w) { mocha_client_remove(w); }
+
+static bool table_find(Window w) {
+    Client *c = mocha_client_find(w);
+    return c && c->state.is_minimized >= 0;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* XIDs the way the server hands them out, a resource base per X client
+   and a counter below it */
+static void make_windows(Window *windows, Window *unmanaged, int count) {
+    for(int i = 0; i < count; i++) {
+        windows[i] = ((Window)(i % 32 + 1) << 21) | (i / 32 * 4 + 1);
+        unmanaged[i] = windows[i] + 2;
+    }
+}
+
+static void shuffle(Window *windows, int count) {
+    for(int i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        Window w = windows[i];
+        windows[i] = windows[j];
+        windows[j] = w;
+    }
+}
+
+static double keep_best(double best, double elapsed, int run) {
+    return run == 0 || elapsed < best ? elapsed : best;
+}
+
+static Timings bench(const Registry *r, const Window *windows,
+                     const Window *unmanaged, const Window *order,
+                     int count) {
+    Timings best = {0};
+    volatile int found = 0;
+    for(int run = 0; run < RUNS; run++) {
+        double start = now();
+        for(int i = 0; i < count; i++) r->add(windows[i]);
+        best.insert = keep_best(best.insert, now() - start, run);
+
+        start = now();
+        for(int pass = 0; pass < LOOKUP_PASSES; pass++)
+            for(int i = 0; i < count; i++) found += r->find(order[i]);
+        best.lookup = keep_best(best.lookup, now() - start, run);
+
+        start = now();
+        for(int pass = 0; pass < LOOKUP_PASSES; pass++)
+            for(int i = 0; i < count; i++) found += r->find(unmanaged[i]);
+        best.miss = keep_best(best.miss, now() - start, run);
+
+        start = now();
+        for(int i = 0; i < count; i++) r->remove(order[i]);
+        best.remove = keep_best(best.remove, now() - start, run);
+    }
+
+    double ns = 1e9 / count;
+    best.insert *= ns;
+    best.lookup *= ns / LOOKUP_PASSES;
+    best.miss *= ns / LOOKUP_PASSES;
+    best.remove *= ns;
+    return best;
+}
+
+int main() {
+    const Registry registries[] = {
+        {"array", old_add, old_remove, old_find},
+        {"table", table_add, table_remove, table_find},
+    };
+    const int counts[] = {256, 1000, 4000, MAX_WINDOWS};
+    static Window windows[MAX_WINDOWS], unmanaged[MAX_WINDOWS],
+        order[MAX_WINDOWS];
+    srand(1);
+
+    printf("%-6s %7s %10s %10s %10s %10s\n", "", "windows", "lookup",
+           "miss", "insert", "remove");
+    for(size_t n = 0; n < sizeof(counts) / sizeof(counts[0]); n++) {
+        int count = counts[n];
+        make_windows(windows, unmanaged, count);
+        for(int i = 0; i < count; i++) order[i] = windows[i];
+        shuffle(order, count);
+        for(size_t r = 0; r < sizeof(registries) / sizeof(registries[0]);
+            r++) {
+            Timings t =
+                bench(&registries[r], windows, unmanaged, order, count);
+            printf("%-6s %7d %7.1f ns %7.1f ns %7.1f ns %7.1f ns\n",
+                   registries[r].name, count, t.lookup, t.miss, t.insert,
+                   t.remove);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util/pixel.h"
+
+/*
+ * Throughput of each conversion kernel on a 4K frame, best of several
+ * runs. Not run by ctest.
+ */
+
+#define FRAME_PIXELS (3840 * 2160)
+#define RUNS 10
+
+typedef struct {
+    const char *name;
+    void (*convert)(uint8_t *data, size_t count);
+    bool supported;
+} Kernel;
+
+/* pixel.c logs which kernel it picked */
+void mocha_log(const char *fmt, ...) {}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *name, void (*convert)(uint8_t *, size_t),
+                  uint8_t *frame) {
+    double best = 0;
+    for(int run = 0; run < RUNS; run++) {
+        double start = now();
+        convert(frame, FRAME_PIXELS);
+        double elapsed = now() - start;
+        if(run == 0 || elapsed < best) best = elapsed;
+    }
+    printf("%-8s %8.0f MPix/s  %6.2f ms per frame\n", name,
+           FRAME_PIXELS / best / 1e6, best * 1e3);
+}
+
+int main() {
+    Kernel kernels[] = {
+        {"scalar", mocha_pixel_rgba_to_argb32_scalar, true},
+#ifdef PIXEL_X86
+        {"sse2", mocha_pixel_rgba_to_argb32_sse2,
+         __builtin_cpu_supports("sse2")},
+        {"avx2", mocha_pixel_rgba_to_argb32_avx2,
+         __builtin_cpu_supports("avx2")},
+#endif
+    };
+    uint8_t *frame = malloc((size_t)FRAME_PIXELS * 4);
+    if(!frame) return 1;
+    srand(1);
+    for(size_t i = 0; i < (size_t)FRAME_PIXELS * 4; i++) frame[i] = rand();
+
+    for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        if(kernels[k].supported)
+            bench(kernels[k].name, kernels[k].convert, frame);
+    bench("picked", mocha_pixel_rgba_to_argb32, frame);
+
+    free(frame);
+    return 0;
+}
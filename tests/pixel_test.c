@@ -0,0 +1,118 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/pixel.h"
+
+/*
+ * Checks every conversion kernel against mocha_pixel_mul_div255() for all
+ * (x, a) pairs, from unaligned starts and with every tail length the SIMD
+ * loops can leave behind.
+ */
+
+#define PAIRS (256 * 256)
+/* Widest kernel step is 8 pixels */
+#define MAX_SHIFT 8
+
+typedef struct {
+    const char *name;
+    void (*convert)(uint8_t *data, size_t count);
+    bool supported;
+} Kernel;
+
+/* pixel.c logs which kernel it picked */
+void mocha_log(const char *fmt, ...) {}
+
+/* Pixel i covers pair (i & 255, i >> 8), with the color channels rotated
+   so every channel position sees every x */
+static void fill_pixels(uint8_t *data, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        uint8_t x = i & 255, a = (i >> 8) & 255;
+        data[4 * i + 0] = x;
+        data[4 * i + 1] = x + 85;
+        data[4 * i + 2] = x + 170;
+        data[4 * i + 3] = a;
+    }
+}
+
+static uint32_t expected(const uint8_t *p) {
+    uint32_t a = p[3];
+    return (a << 24) | (mocha_pixel_mul_div255(p[0], a) << 16) |
+           (mocha_pixel_mul_div255(p[1], a) << 8) |
+           mocha_pixel_mul_div255(p[2], a);
+}
+
+static int check_reference() {
+    for(uint32_t a = 0; a < 256; a++)
+        for(uint32_t x = 0; x < 256; x++)
+            if(mocha_pixel_mul_div255(x, a) != (x * a + 127) / 255) {
+                printf("mul_div255(%u, %u) is not rounded\n", x, a);
+                return 1;
+            }
+    return 0;
+}
+
+/* Convert count pixels starting shift pixels into the buffer and compare
+   them, plus the guard pixels around them that must stay untouched */
+static int check_run(const Kernel *k, uint8_t *buf, const uint8_t *orig,
+                     size_t shift, size_t count) {
+    size_t total = count + 2 * MAX_SHIFT;
+    memcpy(buf, orig, total * 4);
+    k->convert(buf + 4 * shift, count);
+    for(size_t i = 0; i < total; i++) {
+        uint32_t got, want;
+        memcpy(&got, buf + 4 * i, 4);
+        if(i >= shift && i < shift + count)
+            want = expected(orig + 4 * i);
+        else
+            memcpy(&want, orig + 4 * i, 4);
+        if(got != want) {
+            printf("%s: pixel %zu of %zu from %zu is %08x, want %08x\n",
+                   k->name, i, count, shift, got, want);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    Kernel kernels[] = {
+        {"scalar", mocha_pixel_rgba_to_argb32_scalar, true},
+#ifdef PIXEL_X86
+        {"sse2", mocha_pixel_rgba_to_argb32_sse2,
+         __builtin_cpu_supports("sse2")},
+        {"avx2", mocha_pixel_rgba_to_argb32_avx2,
+         __builtin_cpu_supports("avx2")},
+#endif
+    };
+    size_t max_pixels = PAIRS + 2 * MAX_SHIFT;
+    uint8_t *orig = malloc(max_pixels * 4);
+    uint8_t *buf = malloc(max_pixels * 4);
+    if(!orig || !buf) return 1;
+    fill_pixels(orig, max_pixels);
+
+    int failed = check_reference();
+    for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if(!kernels[k].supported) {
+            printf("%s: not supported, skipped\n", kernels[k].name);
+            continue;
+        }
+        int kernel_failed = 0;
+        for(size_t shift = 0; shift < MAX_SHIFT; shift++) {
+            /* Short runs never reach the SIMD loop */
+            for(size_t count = 0; count <= 2 * MAX_SHIFT; count++)
+                kernel_failed |=
+                    check_run(&kernels[k], buf, orig, shift, count);
+            for(size_t tail = 0; tail < MAX_SHIFT; tail++)
+                kernel_failed |= check_run(&kernels[k], buf, orig, shift,
+                                           PAIRS - MAX_SHIFT + tail);
+        }
+        printf("%s: %s\n", kernels[k].name, kernel_failed ? "FAIL" : "ok");
+        failed |= kernel_failed;
+    }
+
+    free(orig);
+    free(buf);
+    return failed;
+}
@@ -0,0 +1,115 @@
+#include <X11/Xlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "main.h"
+#include "util/shm_image.h"
+#include "util/stats.h"
+
+/*
+ * Upload cost of wallpaper and launcher sized images through MIT-SHM and
+ * through XPutImage, against the server on $DISPLAY. Meant for Xvfb:
+ *
+ *     xvfb-run -s "-screen 0 1920x1080x24" ./shm_image_bench
+ *
+ * Each put waits for the previous one to be read, like the shell does
+ * before drawing the next frame. Not run by ctest.
+ */
+
+#define PUTS 100
+#define LAUNCHER_WIDTH 500
+#define LAUNCHER_HEIGHT 400
+
+Display *dpy;
+int screen;
+
+void mocha_log(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+static int trapped_errors = 0;
+static int (*trap_previous_handler)(Display *, XErrorEvent *);
+
+static int trap_error_handler(Display *d, XErrorEvent *e) {
+    trapped_errors++;
+    return 0;
+}
+
+void mocha_trap_errors() {
+    trapped_errors = 0;
+    trap_previous_handler = XSetErrorHandler(trap_error_handler);
+}
+
+int mocha_untrap_errors() {
+    XSync(dpy, False);
+    XSetErrorHandler(trap_previous_handler);
+    return trapped_errors;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *path, const char *name, int width,
+                  int height) {
+    Visual *visual = DefaultVisual(dpy, screen);
+    int depth = DefaultDepth(dpy, screen);
+    ShmImage img;
+    if(!mocha_shm_image_create(&img, visual, depth, width, height)) {
+        printf("%-4s %-9s cannot create a %dx%d image\n", path, name, width,
+               height);
+        return;
+    }
+    Pixmap target = XCreatePixmap(dpy, RootWindow(dpy, screen), width,
+                                  height, depth);
+    GC gc = XCreateGC(dpy, target, 0, NULL);
+    size_t bytes = (size_t)img.ximage->bytes_per_line * height;
+    memset(img.ximage->data, 0x5a, bytes);
+    XSync(dpy, False);
+
+    double start = now();
+    for(int i = 0; i < PUTS; i++) {
+        mocha_shm_image_wait(&img);
+        mocha_shm_image_put(&img, target, gc, 0, 0, width, height);
+    }
+    mocha_shm_image_wait(&img);
+    XSync(dpy, False);
+    double per_put = (now() - start) / PUTS;
+
+    printf("%-4s %-9s %4dx%-4d %7.3f ms per put %8.0f MPix/s\n",
+           img.shared ? "shm" : "put", name, width, height, per_put * 1e3,
+           (double)width * height / per_put / 1e6);
+    XFreeGC(dpy, gc);
+    XFreePixmap(dpy, target);
+    mocha_shm_image_destroy(&img);
+}
+
+int main() {
+    dpy = XOpenDisplay(NULL);
+    if(!dpy) {
+        fprintf(stderr, "Cannot open display\n");
+        return 1;
+    }
+    screen = DefaultScreen(dpy);
+    int wallpaper_width = DisplayWidth(dpy, screen);
+    int wallpaper_height = DisplayHeight(dpy, screen);
+
+    const char *paths[] = {"shm", "put"};
+    for(int i = 0; i < 2; i++) {
+        if(i == 0 && !mocha_shm_available()) continue;
+        if(i == 1) mocha_shm_disable();
+        bench(paths[i], "wallpaper", wallpaper_width, wallpaper_height);
+        bench(paths[i], "launcher", LAUNCHER_WIDTH, LAUNCHER_HEIGHT);
+    }
+
+    XCloseDisplay(dpy);
+    return 0;
+}